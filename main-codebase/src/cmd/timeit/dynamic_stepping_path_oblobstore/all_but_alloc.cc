@@ -0,0 +1,68 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+
+#include "../../../dynamic/oblobstore/stepping_path/oblobstore.h"
+#include "../../../utils/crypto.h"
+#include "../../../utils/measurements.h"
+
+using namespace dyno::crypto;
+using namespace dyno::measurement;
+using namespace dyno::dynamic_stepping_path_oblobstore;
+
+const static std::string test_name = "doblobstore";
+
+// Chunks of the block size, values of up to kMaxChunks of them; every
+// access is padded to kMaxChunks chunks.
+static constexpr const size_t kMaxChunks = 4;
+
+int main(int argc, char **argv) {
+  Config conf(argc, argv);
+  if (!conf.is_valid_)
+    return 1;
+
+  auto enc_key = GenerateKey();
+  for (const auto &bs : conf.block_sizes_) {
+    size_t max_val_len = kMaxChunks * (bs - sizeof(ChunkKey));
+    Blob val(max_val_len, 1);
+    for (const auto &po2 : conf.po2s_) {
+      Run total(test_name, po2, bs, conf.max_mem_level_);
+      for (int r = 0; r < conf.num_runs_; ++r) {
+        Measurement prev;
+        Run run(test_name, po2, bs);
+        auto store = std::make_unique<OBlobStore>(
+            po2, bs, max_val_len, conf.store_path_, conf.max_mem_level_);
+        run.alloc_.time_ = run.Elapsed();
+        prev = {run.Elapsed(),
+                store->MemoryAccessCount(),
+                store->MemoryBytesMovedTotal()};
+
+        store->Put(1, val, enc_key);
+        run.insert_.time_ = run.Elapsed() - prev.time_;
+        run.insert_.accesses_ = store->MemoryAccessCount() - prev.accesses_;
+        run.insert_.bytes = store->MemoryBytesMovedTotal() - prev.bytes;
+        prev = {run.Elapsed(),
+                store->MemoryAccessCount(),
+                store->MemoryBytesMovedTotal()};
+
+        store->Get(1, enc_key);
+        run.search_.time_ = run.Elapsed() - prev.time_;
+        run.search_.accesses_ = store->MemoryAccessCount() - prev.accesses_;
+        run.search_.bytes = store->MemoryBytesMovedTotal() - prev.bytes;
+        prev = {run.Elapsed(),
+                store->MemoryAccessCount(),
+                store->MemoryBytesMovedTotal()};
+
+        store->Remove(1, enc_key);
+        run.delete_.time_ = run.Elapsed() - prev.time_;
+        run.delete_.accesses_ = store->MemoryAccessCount() - prev.accesses_;
+        run.delete_.bytes = store->MemoryBytesMovedTotal() - prev.bytes;
+
+        total = total + run;
+        store.reset(); // cleanup
+      }
+      std::cout << (total / conf.num_runs_) << std::endl;
+    }
+  }
+  return 0;
+}
@@ -3,12 +3,14 @@
 #include <string>
 
 #include "../../../dynamic/oheap/stepping_path/oheap.h"
+#include "../../../store/posix_single_file_store.h"
 #include "../../../utils/crypto.h"
 #include "../../../utils/measurements.h"
 
 using namespace dyno::crypto;
 using namespace dyno::measurement;
 using namespace dyno::dynamic_stepping_path_oheap;
+using namespace dyno::store;
 
 const static std::string test_name = "doheap";
 
@@ -20,13 +22,16 @@ int main(int argc, char **argv) {
   auto enc_key = GenerateKey();
   for (const auto &bs : conf.block_sizes_) {
     for (const auto &po2 : conf.po2s_) {
-      Run total(test_name, po2, bs);
+      Run total(test_name, po2, bs, conf.max_mem_level_);
       size_t size = 1UL << po2;
       for (int r = 0; r < conf.num_runs_; ++r) {
         Measurement prev;
         Run run(test_name, po2, bs);
 
-        auto oheap = std::make_unique<OHeap>(po2, bs);
+        auto oheap = std::make_unique<OHeap>(
+            po2, bs, conf.store_path_, conf.max_mem_level_);
+        if (oheap->IsOnDisk())
+          Uncache();
         run.alloc_.time_ = run.Elapsed();
         prev = {run.Elapsed(),
                 oheap->MemoryAccessCount(),
@@ -34,6 +39,8 @@ int main(int argc, char **argv) {
 
         oheap->Grow(enc_key);
         oheap->Insert(1, {}, enc_key, false);
+        if (oheap->IsOnDisk())
+          Uncache();
         run.insert_.time_ = run.Elapsed() - prev.time_;
         run.insert_.accesses_ = oheap->MemoryAccessCount() - prev.accesses_;
         run.insert_.bytes = oheap->MemoryBytesMovedTotal() - prev.bytes;
@@ -42,6 +49,8 @@ int main(int argc, char **argv) {
                 oheap->MemoryBytesMovedTotal()};
 
         oheap->FindMin(enc_key, false);
+        if (oheap->IsOnDisk())
+          Uncache();
         run.search_.time_ = run.Elapsed() - prev.time_;
         run.search_.accesses_ = oheap->MemoryAccessCount() - prev.accesses_;
         run.search_.bytes = oheap->MemoryBytesMovedTotal() - prev.bytes;
@@ -50,10 +59,15 @@ int main(int argc, char **argv) {
                 oheap->MemoryBytesMovedTotal()};
 
         oheap->ExtractMin(enc_key);
+        if (oheap->IsOnDisk())
+          Uncache();
         run.delete_.time_ = run.Elapsed() - prev.time_;
         run.delete_.accesses_ = oheap->MemoryAccessCount() - prev.accesses_;
         run.delete_.bytes = oheap->MemoryBytesMovedTotal() - prev.bytes;
 
+        run.is_on_disk_ = oheap->IsOnDisk();
+        if (r == 0)
+          total.is_on_disk_ = run.is_on_disk_;
         total = total + run;
         oheap.reset(); // cleanup
       }
@@ -3,12 +3,14 @@
 #include <string>
 
 #include "../../../dynamic/oram/stepping_path/oram.h"
+#include "../../../store/posix_single_file_store.h"
 #include "../../../utils/crypto.h"
 #include "../../../utils/measurements.h"
 
 using namespace dyno::crypto;
 using namespace dyno::measurement;
 using namespace dyno::dynamic_stepping_path_oram;
+using namespace dyno::store;
 
 const static std::string test_name = "doram";
 
@@ -20,13 +22,16 @@ int main(int argc, char **argv) {
   auto enc_key = GenerateKey();
   for (const auto &bs : conf.block_sizes_) {
     for (const auto &po2 : conf.po2s_) {
-      Run total(test_name, po2, bs);
+      Run total(test_name, po2, bs, conf.max_mem_level_);
       size_t size = 1UL << po2;
       for (int r = 0; r < conf.num_runs_; ++r) {
         Measurement prev;
         Run run(test_name, po2, bs);
 
-        auto oram = std::make_unique<ORam>(po2, bs);
+        auto oram = std::make_unique<ORam>(
+            po2, bs, conf.store_path_, conf.max_mem_level_);
+        if (oram->IsOnDisk())
+          Uncache();
         run.alloc_.time_ = run.Elapsed();
         prev = {run.Elapsed(),
                 oram->MemoryAccessCount(),
@@ -34,6 +39,8 @@ int main(int argc, char **argv) {
 
         oram->Grow(enc_key);
         oram->Insert(1, {}, enc_key);
+        if (oram->IsOnDisk())
+          Uncache();
         run.insert_.time_ = run.Elapsed() - prev.time_;
         run.insert_.accesses_ = oram->MemoryAccessCount() - prev.accesses_;
         run.insert_.bytes = oram->MemoryBytesMovedTotal() - prev.bytes;
@@ -42,6 +49,8 @@ int main(int argc, char **argv) {
                 oram->MemoryBytesMovedTotal()};
 
         oram->Read(1, enc_key);
+        if (oram->IsOnDisk())
+          Uncache();
         run.search_.time_ = run.Elapsed() - prev.time_;
         run.search_.accesses_ = oram->MemoryAccessCount() - prev.accesses_;
         run.search_.bytes = oram->MemoryBytesMovedTotal() - prev.bytes;
@@ -50,10 +59,15 @@ int main(int argc, char **argv) {
                 oram->MemoryBytesMovedTotal()};
 
         oram->ReadAndRemove(1, enc_key);
+        if (oram->IsOnDisk())
+          Uncache();
         run.delete_.time_ = run.Elapsed() - prev.time_;
         run.delete_.accesses_ = oram->MemoryAccessCount() - prev.accesses_;
         run.delete_.bytes = oram->MemoryBytesMovedTotal() - prev.bytes;
 
+        run.is_on_disk_ = oram->IsOnDisk();
+        if (r == 0)
+          total.is_on_disk_ = run.is_on_disk_;
         total = total + run;
         oram.reset(); // cleanup
       }
@@ -0,0 +1,62 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+
+#include "../../../dynamic/ovector/stepping_path/ovector.h"
+#include "../../../utils/crypto.h"
+#include "../../../utils/measurements.h"
+
+using namespace dyno::crypto;
+using namespace dyno::measurement;
+using namespace dyno::dynamic_stepping_path_ovector;
+
+const static std::string test_name = "dovector";
+
+int main(int argc, char **argv) {
+  Config conf(argc, argv);
+  if (!conf.is_valid_)
+    return 1;
+
+  auto enc_key = GenerateKey();
+  for (const auto &bs : conf.block_sizes_) {
+    for (const auto &po2 : conf.po2s_) {
+      Run total(test_name, po2, bs);
+      for (int r = 0; r < conf.num_runs_; ++r) {
+        Measurement prev;
+        Run run(test_name, po2, bs);
+
+        auto vec = std::make_unique<OVector>(po2, bs);
+        run.alloc_.time_ = run.Elapsed();
+        prev = {run.Elapsed(),
+                vec->MemoryAccessCount(),
+                vec->MemoryBytesMovedTotal()};
+
+        vec->PushBack(std::make_unique<uint8_t[]>(bs), enc_key);
+        run.insert_.time_ = run.Elapsed() - prev.time_;
+        run.insert_.accesses_ = vec->MemoryAccessCount() - prev.accesses_;
+        run.insert_.bytes = vec->MemoryBytesMovedTotal() - prev.bytes;
+        prev = {run.Elapsed(),
+                vec->MemoryAccessCount(),
+                vec->MemoryBytesMovedTotal()};
+
+        vec->Get(vec->Size() - 1, enc_key);
+        run.search_.time_ = run.Elapsed() - prev.time_;
+        run.search_.accesses_ = vec->MemoryAccessCount() - prev.accesses_;
+        run.search_.bytes = vec->MemoryBytesMovedTotal() - prev.bytes;
+        prev = {run.Elapsed(),
+                vec->MemoryAccessCount(),
+                vec->MemoryBytesMovedTotal()};
+
+        vec->PopBack(enc_key);
+        run.delete_.time_ = run.Elapsed() - prev.time_;
+        run.delete_.accesses_ = vec->MemoryAccessCount() - prev.accesses_;
+        run.delete_.bytes = vec->MemoryBytesMovedTotal() - prev.bytes;
+
+        total = total + run;
+        vec.reset(); // cleanup
+      }
+      std::cout << (total / conf.num_runs_) << std::endl;
+    }
+  }
+  return 0;
+}
@@ -3,12 +3,14 @@
 #include <memory>
 
 #include "../../../static/oheap/path/oheap.h"
+#include "../../../store/posix_single_file_store.h"
 #include "../../../utils/crypto.h"
 #include "../../../utils/measurements.h"
 
 using namespace dyno::crypto;
 using namespace dyno::measurement;
 using namespace dyno::static_path_oheap;
+using namespace dyno::store;
 
 const static std::string test_name = "soheap";
 
@@ -20,18 +22,23 @@ int main(int argc, char **argv) {
   auto enc_key = GenerateKey();
   for (const auto &bs : conf.block_sizes_) {
     for (const auto &po2 : conf.po2s_) {
-      Run total(test_name, po2, bs);
+      Run total(test_name, po2, bs, conf.max_mem_level_);
       size_t size = 1UL << po2;
       for (int r = 0; r < conf.num_runs_; ++r) {
         Measurement prev;
         Run run(test_name, po2, bs);
-        auto oheap = std::make_unique<OHeap>(size, bs);
+        auto oheap = std::make_unique<OHeap>(
+            size, bs, conf.store_path_, conf.max_mem_level_);
+        if (oheap->IsOnDisk())
+          Uncache();
         run.alloc_.time_ = run.Elapsed();
         prev = {run.Elapsed(),
                 oheap->MemoryAccessCount(),
                 oheap->MemoryBytesMovedTotal()};
 
         oheap->Insert(1, {}, enc_key);
+        if (oheap->IsOnDisk())
+          Uncache();
         run.insert_.time_ = run.Elapsed() - prev.time_;
         run.insert_.accesses_ = oheap->MemoryAccessCount() - prev.accesses_;
         run.insert_.bytes = oheap->MemoryBytesMovedTotal() - prev.bytes;
@@ -40,6 +47,8 @@ int main(int argc, char **argv) {
                 oheap->MemoryBytesMovedTotal()};
 
         oheap->FindMin(enc_key);
+        if (oheap->IsOnDisk())
+          Uncache();
         run.search_.time_ = run.Elapsed() - prev.time_;
         run.search_.accesses_ = oheap->MemoryAccessCount() - prev.accesses_;
         run.search_.bytes = oheap->MemoryBytesMovedTotal() - prev.bytes;
@@ -48,10 +57,15 @@ int main(int argc, char **argv) {
                 oheap->MemoryBytesMovedTotal()};
 
         oheap->ExtractMin(enc_key);
+        if (oheap->IsOnDisk())
+          Uncache();
         run.delete_.time_ = run.Elapsed() - prev.time_;
         run.delete_.accesses_ = oheap->MemoryAccessCount() - prev.accesses_;
         run.delete_.bytes = oheap->MemoryBytesMovedTotal() - prev.bytes;
 
+        run.is_on_disk_ = oheap->IsOnDisk();
+        if (r == 0)
+          total.is_on_disk_ = run.is_on_disk_;
         total = total + run;
         oheap.reset(); // cleanup
       }
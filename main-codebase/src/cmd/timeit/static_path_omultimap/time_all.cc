@@ -0,0 +1,79 @@
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "../../../static/omultimap/path/omultimap.h"
+#include "../../../store/posix_single_file_store.h"
+#include "../../../utils/crypto.h"
+#include "../../../utils/measurements.h"
+
+using namespace dyno::crypto;
+using namespace dyno::measurement;
+using namespace dyno::static_path_omultimap;
+using namespace dyno::store;
+
+const static std::string test_name = "somultimap";
+
+// Pages of the block size hold values of kValLen bytes; there is room for
+// kValsPerKey values per key on average. Insert appends one full page and
+// search reads it back; there is no removal.
+static constexpr const size_t kValLen = 8;
+static constexpr const size_t kValsPerKey = 16;
+
+int main(int argc, char **argv) {
+  Config conf(argc, argv);
+  if (!conf.is_valid_)
+    return 1;
+
+  auto enc_key = GenerateKey();
+  for (const auto &bs : conf.block_sizes_) {
+    size_t per_page = bs / kValLen;
+    for (const auto &po2 : conf.po2s_) {
+      Run total(test_name, po2, bs, conf.max_mem_level_);
+      size_t size = 1UL << po2;
+      for (int r = 0; r < conf.num_runs_; ++r) {
+        Measurement prev;
+        Run run(test_name, po2, bs);
+
+        auto omm = std::make_unique<OMultiMap>(
+            size, size * kValsPerKey, kValLen, bs, conf.store_path_,
+            conf.max_mem_level_);
+        if (omm->IsOnDisk())
+          Uncache();
+        run.alloc_.time_ = run.Elapsed();
+        prev = {run.Elapsed(),
+                omm->MemoryAccessCount(),
+                omm->MemoryBytesMovedTotal()};
+
+        std::vector<Val> vals;
+        for (size_t i = 0; i < per_page; ++i)
+          vals.push_back(std::make_unique<uint8_t[]>(kValLen));
+        omm->Append(1, std::move(vals), enc_key);
+        if (omm->IsOnDisk())
+          Uncache();
+        run.insert_.time_ = run.Elapsed() - prev.time_;
+        run.insert_.accesses_ = omm->MemoryAccessCount() - prev.accesses_;
+        run.insert_.bytes = omm->MemoryBytesMovedTotal() - prev.bytes;
+        prev = {run.Elapsed(),
+                omm->MemoryAccessCount(),
+                omm->MemoryBytesMovedTotal()};
+
+        omm->ReadAll(1, per_page, enc_key);
+        if (omm->IsOnDisk())
+          Uncache();
+        run.search_.time_ = run.Elapsed() - prev.time_;
+        run.search_.accesses_ = omm->MemoryAccessCount() - prev.accesses_;
+        run.search_.bytes = omm->MemoryBytesMovedTotal() - prev.bytes;
+
+        run.is_on_disk_ = omm->IsOnDisk();
+        if (r == 0)
+          total.is_on_disk_ = run.is_on_disk_;
+        total = total + run;
+        omm.reset(); // cleanup
+      }
+      std::cout << (total / conf.num_runs_) << std::endl;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,91 @@
+#include <chrono>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../../../static/oram/path/concurrent_oram.h"
+#include "../../../utils/crypto.h"
+#include "../../../utils/measurements.h"
+
+using namespace dyno::crypto;
+using namespace dyno::measurement;
+using namespace dyno::static_path_oram;
+
+const static std::string test_name = "coram";
+const static unsigned int kClients = 16;
+
+// Each phase issues one request per client at once; the reported numbers are
+// per request.
+int main(int argc, char **argv) {
+  Config conf(argc, argv);
+  if (!conf.is_valid_)
+    return 1;
+
+  auto enc_key = GenerateKey();
+  for (const auto &bs : conf.block_sizes_) {
+    for (const auto &po2 : conf.po2s_) {
+      Run total(test_name, po2, bs, conf.max_mem_level_);
+      size_t size = 1UL << po2;
+      for (int r = 0; r < conf.num_runs_; ++r) {
+        Measurement prev;
+        Run run(test_name, po2, bs);
+
+        auto oram = std::make_unique<ConcurrentORam>(
+            size, bs, conf.store_path_, conf.max_mem_level_, kClients);
+        run.alloc_.time_ = run.Elapsed();
+        prev = {run.Elapsed(),
+                oram->MemoryAccessCount(),
+                oram->MemoryBytesMovedTotal()};
+
+        std::vector<std::future<void>> inserts;
+        for (dyno::static_path_oram::Key k = 1; k <= kClients; ++k)
+          inserts.push_back(oram->Insert(k, {}, enc_key));
+        for (auto &f : inserts)
+          f.wait();
+        run.insert_.time_ = (run.Elapsed() - prev.time_) / kClients;
+        run.insert_.accesses_ =
+            (oram->MemoryAccessCount() - prev.accesses_) / kClients;
+        run.insert_.bytes =
+            (oram->MemoryBytesMovedTotal() - prev.bytes) / kClients;
+        prev = {run.Elapsed(),
+                oram->MemoryAccessCount(),
+                oram->MemoryBytesMovedTotal()};
+
+        std::vector<std::future<Block>> reads;
+        for (dyno::static_path_oram::Key k = 1; k <= kClients; ++k)
+          reads.push_back(oram->Read(k, enc_key));
+        for (auto &f : reads)
+          f.wait();
+        run.search_.time_ = (run.Elapsed() - prev.time_) / kClients;
+        run.search_.accesses_ =
+            (oram->MemoryAccessCount() - prev.accesses_) / kClients;
+        run.search_.bytes =
+            (oram->MemoryBytesMovedTotal() - prev.bytes) / kClients;
+        prev = {run.Elapsed(),
+                oram->MemoryAccessCount(),
+                oram->MemoryBytesMovedTotal()};
+
+        std::vector<std::future<Block>> deletes;
+        for (dyno::static_path_oram::Key k = 1; k <= kClients; ++k)
+          deletes.push_back(oram->ReadAndRemove(k, enc_key));
+        for (auto &f : deletes)
+          f.wait();
+        run.delete_.time_ = (run.Elapsed() - prev.time_) / kClients;
+        run.delete_.accesses_ =
+            (oram->MemoryAccessCount() - prev.accesses_) / kClients;
+        run.delete_.bytes =
+            (oram->MemoryBytesMovedTotal() - prev.bytes) / kClients;
+
+        run.is_on_disk_ = oram->IsOnDisk();
+        if (r == 0)
+          total.is_on_disk_ = run.is_on_disk_;
+        total = total + run;
+        oram.reset(); // cleanup
+      }
+      std::cout << (total / conf.num_runs_) << std::endl;
+    }
+  }
+  return 0;
+}
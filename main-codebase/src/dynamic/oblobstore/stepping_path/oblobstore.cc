@@ -0,0 +1,178 @@
+#include "oblobstore.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../../../utils/bytes.h"
+#include "../../../utils/crypto.h"
+
+namespace dyno::dynamic_stepping_path_oblobstore {
+
+OBlobStore::OBlobStore(size_t chunk_len, size_t max_val_len, std::string path,
+                       uint8_t max_levels_in_mem, Options opts)
+    : chunk_len_(chunk_len),
+      payload_len_(chunk_len - sizeof(ChunkKey)),
+      max_val_len_(max_val_len),
+      opts_(std::move(opts)),
+      index_(sizeof(Entry), path, max_levels_in_mem),
+      chunks_(chunk_len, ChunksPath(path), max_levels_in_mem) {
+  CheckOptions();
+}
+
+OBlobStore::OBlobStore(int starting_size_power_of_two, size_t chunk_len,
+                       size_t max_val_len, std::string path,
+                       uint8_t max_levels_in_mem, Options opts)
+    : chunk_len_(chunk_len),
+      payload_len_(chunk_len - sizeof(ChunkKey)),
+      max_val_len_(max_val_len),
+      opts_(std::move(opts)),
+      index_(starting_size_power_of_two, sizeof(Entry), path,
+             max_levels_in_mem),
+      chunks_(starting_size_power_of_two, chunk_len, ChunksPath(path),
+              max_levels_in_mem),
+      next_chunk_(chunks_.Capacity() + 1) {
+  CheckOptions();
+}
+
+void OBlobStore::Put(Key k, const Blob &val, crypto::Key enc_key) {
+  assert(val.size() <= max_val_len_);
+  Entry old;
+  // Until the first Put, the index has no capacity (and no keys).
+  auto old_val = index_.Capacity() ? index_.ReadAndRemove(k, enc_key) : Val();
+  if (old_val)
+    bytes::FromBytes(old_val.get(), old);
+  FreeChunks(old, enc_key);
+
+  size_t num_chunks = ChunksFor(val.size());
+  // Room for the whole class up front, so the Grow steps do not tell the
+  // real chunk count.
+  while (chunks_.Capacity() < next_chunk_ - 1 + PaddedChunks(num_chunks))
+    chunks_.Grow(enc_key);
+  std::vector<ChunkKey> keys(num_chunks);
+  for (auto &ck : keys)
+    ck = AllocChunk();
+  // Last chunk first, so every chunk knows the key of the next.
+  ChunkKey next = 0;
+  for (size_t i = num_chunks; i-- > 0;) {
+    auto chunk = std::make_unique<uint8_t[]>(chunk_len_);
+    auto link = bytes::ToBytes(next);
+    std::copy(link.begin(), link.end(), chunk.get());
+    size_t from = i * payload_len_;
+    size_t len = std::min(payload_len_, val.size() - from);
+    std::copy_n(val.data() + from, len, chunk.get() + sizeof(ChunkKey));
+    chunks_.Insert(keys[i], std::move(chunk), enc_key);
+    next = keys[i];
+  }
+  DummyChunkAccesses(PaddedChunks(num_chunks) - num_chunks, enc_key);
+
+  Entry e{uint32_t(val.size()), next};
+  auto e_bytes = bytes::ToBytes(e);
+  auto e_val = std::make_unique<uint8_t[]>(sizeof(Entry));
+  std::copy(e_bytes.begin(), e_bytes.end(), e_val.get());
+  if (index_.Size() == index_.Capacity())
+    index_.Grow(enc_key);
+  index_.Insert(k, std::move(e_val), enc_key);
+}
+
+std::optional<Blob> OBlobStore::Get(Key k, crypto::Key enc_key) {
+  Entry e;
+  auto e_val = index_.Capacity() ? index_.Read(k, enc_key) : Val();
+  if (e_val)
+    bytes::FromBytes(e_val.get(), e);
+
+  size_t num_chunks = ChunksFor(e.len_);
+  Blob res(e.len_);
+  ChunkKey ck = e.first_;
+  for (size_t i = 0; i < num_chunks; ++i) {
+    auto chunk = chunks_.Read(ck, enc_key);
+    assert(chunk.key_ == ck);
+    size_t from = i * payload_len_;
+    size_t len = std::min(payload_len_, res.size() - from);
+    std::copy_n(chunk.val_.get() + sizeof(ChunkKey), len, res.data() + from);
+    bytes::FromBytes(chunk.val_.get(), ck);
+  }
+  DummyChunkAccesses(PaddedChunks(num_chunks) - num_chunks, enc_key);
+  if (!e_val)
+    return std::nullopt;
+  return res;
+}
+
+bool OBlobStore::Remove(Key k, crypto::Key enc_key) {
+  Entry e;
+  auto e_val = index_.Capacity() ? index_.ReadAndRemove(k, enc_key) : Val();
+  if (e_val)
+    bytes::FromBytes(e_val.get(), e);
+  FreeChunks(e, enc_key);
+  return e_val != nullptr;
+}
+
+uint64_t OBlobStore::MemoryAccessCount() const {
+  return index_.MemoryAccessCount() + chunks_.MemoryAccessCount();
+}
+
+uint64_t OBlobStore::MemoryBytesMovedTotal() const {
+  return index_.MemoryBytesMovedTotal() + chunks_.MemoryBytesMovedTotal();
+}
+
+std::string OBlobStore::ChunksPath(const std::string &path) {
+  return path.empty() ? path : path + ".chunks";
+}
+
+void OBlobStore::CheckOptions() const {
+  assert(chunk_len_ > sizeof(ChunkKey));
+  assert(std::is_sorted(opts_.size_classes_.begin(),
+                        opts_.size_classes_.end()));
+  assert(opts_.size_classes_.empty() ||
+         opts_.size_classes_.back() >= ChunksFor(max_val_len_));
+}
+
+size_t OBlobStore::ChunksFor(size_t len) const {
+  return (len + payload_len_ - 1) / payload_len_;
+}
+
+size_t OBlobStore::PaddedChunks(size_t num_chunks) const {
+  if (opts_.size_classes_.empty())
+    return ChunksFor(max_val_len_);
+  auto it = std::lower_bound(opts_.size_classes_.begin(),
+                             opts_.size_classes_.end(), num_chunks);
+  assert(it != opts_.size_classes_.end());
+  return *it;
+}
+
+// Freed chunks are reused first. Put has grown the chunk ORAM already.
+ChunkKey OBlobStore::AllocChunk() {
+  if (!free_chunks_.empty()) {
+    auto res = free_chunks_.back();
+    free_chunks_.pop_back();
+    return res;
+  }
+  assert(next_chunk_ <= chunks_.Capacity());
+  return next_chunk_++;
+}
+
+void OBlobStore::FreeChunks(Entry e, crypto::Key enc_key) {
+  size_t num_chunks = ChunksFor(e.len_);
+  ChunkKey ck = e.first_;
+  for (size_t i = 0; i < num_chunks; ++i) {
+    auto chunk = chunks_.ReadAndRemove(ck, enc_key);
+    assert(chunk.key_ == ck);
+    free_chunks_.push_back(ck);
+    bytes::FromBytes(chunk.val_.get(), ck);
+  }
+  DummyChunkAccesses(PaddedChunks(num_chunks) - num_chunks, enc_key);
+}
+
+void OBlobStore::DummyChunkAccesses(size_t n, crypto::Key enc_key) {
+  if (!chunks_.Capacity()) // Nothing stored yet.
+    return;
+  for (size_t i = 0; i < n; ++i)
+    chunks_.DummyAccess(enc_key);
+}
+} // namespace dyno::dynamic_stepping_path_oblobstore
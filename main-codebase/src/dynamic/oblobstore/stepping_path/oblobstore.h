@@ -0,0 +1,87 @@
+#ifndef DYNO_DYNAMIC_OBLOBSTORE_STEPPING_PATH_OBLOBSTORE_H_
+#define DYNO_DYNAMIC_OBLOBSTORE_STEPPING_PATH_OBLOBSTORE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "../../omap/stepping_path/omap.h"
+#include "../../oram/stepping_path/oram.h"
+#include "../../../utils/crypto.h"
+
+namespace dyno::dynamic_stepping_path_oblobstore {
+
+using Key = dynamic_stepping_path_omap::Key;
+using Val = dynamic_stepping_path_omap::Val;
+using ChunkKey = dynamic_stepping_path_oram::Key;
+using Blob = std::vector<uint8_t>;
+
+class Options {
+ public:
+  // Increasing chunk counts. An access is padded to the smallest class that
+  // holds the blob (a missing blob is in the smallest), which it reveals.
+  // Empty means a single class, of the chunks of a max_val_len blob.
+  std::vector<size_t> size_classes_;
+};
+
+// Values of any length up to max_val_len. A value is split into chunks, each
+// one block of a dynamic ORAM, linked by the key of the next chunk; an OMap
+// index maps each key to the value's length and first chunk. So storage is
+// proportional to the stored bytes, not to max_val_len per value, and an
+// access reads its size class's worth of chunks.
+//
+// The index and the chunk ORAM Grow as needed, so, as with the dynamic
+// structures, the number of Grow steps reveals how much is stored. Put grows
+// the chunk ORAM for its whole size class before it allocates any chunk.
+class OBlobStore {
+ public:
+  // chunk_len is the chunk ORAM's block size, including the link to the next
+  // chunk. PosixSingleFile for the index at path and the chunk ORAM at
+  // path.chunks -- On file store error reverts to RAM store.
+  OBlobStore(size_t chunk_len, size_t max_val_len, std::string path = "",
+             uint8_t max_levels_in_mem = 0, Options opts = Options());
+  // Only implemented for benchmarks.
+  OBlobStore(int starting_size_power_of_two, size_t chunk_len,
+             size_t max_val_len, std::string path = "",
+             uint8_t max_levels_in_mem = 0, Options opts = Options());
+  // Inserts or replaces.
+  void Put(Key k, const Blob &val, crypto::Key enc_key);
+  std::optional<Blob> Get(Key k, crypto::Key enc_key);
+  // Returns whether k was there.
+  bool Remove(Key k, crypto::Key enc_key);
+  [[nodiscard]] size_t Size() const { return index_.Size(); }
+  [[nodiscard]] size_t NumChunks() const { return chunks_.Size(); }
+  [[nodiscard]] uint64_t MemoryAccessCount() const;
+  [[nodiscard]] uint64_t MemoryBytesMovedTotal() const;
+
+ private:
+  // The index's value for a key.
+  class Entry {
+   public:
+    uint32_t len_ = 0;
+    ChunkKey first_ = 0;
+  };
+
+  const size_t chunk_len_;
+  const size_t payload_len_; // chunk_len_ minus the link.
+  const size_t max_val_len_;
+  const Options opts_;
+  dynamic_stepping_path_omap::OMap index_;
+  dynamic_stepping_path_oram::ORam chunks_;
+  ChunkKey next_chunk_ = 1; // Lowest never used.
+  std::vector<ChunkKey> free_chunks_;
+
+  static std::string ChunksPath(const std::string &path);
+  void CheckOptions() const;
+  [[nodiscard]] size_t ChunksFor(size_t len) const;
+  [[nodiscard]] size_t PaddedChunks(size_t num_chunks) const;
+  ChunkKey AllocChunk();
+  // Removes the chunks of entry e, padded to its class.
+  void FreeChunks(Entry e, crypto::Key enc_key);
+  void DummyChunkAccesses(size_t n, crypto::Key enc_key);
+};
+} // namespace dyno::dynamic_stepping_path_oblobstore
+
+#endif //DYNO_DYNAMIC_OBLOBSTORE_STEPPING_PATH_OBLOBSTORE_H_
@@ -1,52 +1,68 @@
 #include "oheap.h"
 
+#include <algorithm>
+#include <array>
 #include <cassert>
 #include <cstddef>
+#include <functional>
+#include <iterator>
 #include <memory>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "../../../static/oheap/path/oheap.h"
 #include "../../../utils/crypto.h"
 
 namespace dyno::dynamic_stepping_path_oheap {
 
-OHeap::OHeap(int starting_size_power_of_two, size_t val_len)
+OHeap::OHeap(int starting_size_power_of_two, size_t val_len, std::string path,
+             uint8_t max_levels_in_mem, Options opts)
     : capacity_(1UL << starting_size_power_of_two),
       val_len_(val_len),
-      size_(1UL << starting_size_power_of_two) {
-  auto base_cap = capacity_ >> 1;
+      size_(1UL << starting_size_power_of_two),
+      steps_(opts.growth_factor_),
+      store_pool_(std::move(path), max_levels_in_mem),
+      pool_(opts.num_threads_),
+      grow_ahead_(opts.grow_ahead_) {
+  std::array<size_t, 2> caps;
+  caps[0] = steps_.Below(capacity_);
+  caps[1] = steps_.Above(caps[0]);
   for (int i = 0; i < 2; ++i)
-    sub_oheaps_[i] = std::make_unique<POHeap>(base_cap << i, val_len_);
+    if (caps[i])
+      sub_oheaps_[i] = NewSubOHeap(caps[i]);
+  StartMigrator();
 }
 
-namespace {
-bool IsPowerOfTwo(size_t x) {
-  return !(x & (x - 1));
-}
-} // namespace
-
 void OHeap::Grow(crypto::Key enc_key) {
+  auto lock = Foreground(enc_key);
   if (capacity_ == 0) {
-    sub_oheaps_[1] = std::make_unique<POHeap>(1, val_len_);
+    sub_oheaps_[1] = NewSubOHeap(1);
     ++capacity_;
     return;
   }
 
-  if (IsPowerOfTwo(capacity_)) {
+  if (steps_.IsStep(capacity_)) {
     assert(sub_oheaps_[1] != nullptr);
     sub_oheaps_[0] = std::move(sub_oheaps_[1]);
-    sub_oheaps_[1] = std::make_unique<POHeap>(2 * capacity_, val_len_);
+    sub_oheaps_[1] = NewSubOHeap(steps_.Above(capacity_));
   }
 
   auto start_accesses = SubOHeapsMemoryAccessCountSum();
   auto start_bytes = SubOHeapsMemoryBytesMovedTotalSum();
   assert(sub_oheaps_[0] != nullptr && sub_oheaps_[1] != nullptr);
-  auto move_bl = sub_oheaps_[0]->ExtractMin(enc_key);
-  if (!move_bl.meta_.pos_) {
-    sub_oheaps_[1]->DummyAccess(enc_key);
-  } else {
-    sub_oheaps_[1]->Insert(move_bl.meta_.key_, std::move(move_bl.val_),
-                           enc_key);
-  }
+  size_t moves = MovesPerGrow(sub_oheaps_[0]->Capacity());
+  std::vector<Block> moved(moves);
+  Move(moves,
+       [&](size_t i) { moved[i] = sub_oheaps_[0]->ExtractMin(enc_key); },
+       [&](size_t i) {
+         if (!moved[i].meta_.pos_) {
+           sub_oheaps_[1]->DummyAccess(enc_key);
+         } else {
+           sub_oheaps_[1]->Insert(moved[i].meta_.key_,
+                                  std::move(moved[i].val_), enc_key);
+         }
+       });
   ++capacity_;
   memory_access_count_ += SubOHeapsMemoryAccessCountSum() - start_accesses;
   memory_bytes_moved_total_ +=
@@ -54,6 +70,7 @@ void OHeap::Grow(crypto::Key enc_key) {
 }
 
 void OHeap::Shrink(crypto::Key enc_key) {
+  auto lock = Foreground(enc_key);
   if (capacity_ == 0)
     return;
 
@@ -70,88 +87,186 @@ void OHeap::Shrink(crypto::Key enc_key) {
   assert(sub_oheaps_[0] != nullptr && sub_oheaps_[1] != nullptr);
   auto start_accesses = SubOHeapsMemoryAccessCountSum();
   auto start_bytes = SubOHeapsMemoryBytesMovedTotalSum();
-  for (int count = 0; count < 2; ++count) {
-    Block move_bl(true);
-    if (sub_oheaps_[0]->Size() < sub_oheaps_[0]->Capacity()) {
-      move_bl = sub_oheaps_[1]->ExtractMin(enc_key);
-    } else {
-      sub_oheaps_[1]->DummyAccess(enc_key);
-    }
-
-    if (!move_bl.meta_.pos_) {
-      sub_oheaps_[0]->DummyAccess(enc_key);
-    } else {
-      sub_oheaps_[1]->Insert(move_bl.meta_.key_, std::move(move_bl.val_),
-                             enc_key);
-    }
-  }
+  // As in the dynamic OMap, the smaller one's room is counted down instead of
+  // reading its size during the moves.
+  size_t room = sub_oheaps_[0]->Capacity() - sub_oheaps_[0]->Size();
+  size_t moves = MovesPerGrow(sub_oheaps_[0]->Capacity());
+  std::vector<Block> moved(moves);
+  Move(moves,
+       [&](size_t i) {
+         moved[i] = Block(true);
+         if (room) {
+           moved[i] = sub_oheaps_[1]->ExtractMin(enc_key);
+           if (moved[i].meta_.pos_)
+             --room;
+         } else {
+           sub_oheaps_[1]->DummyAccess(enc_key);
+         }
+       },
+       [&](size_t i) {
+         if (!moved[i].meta_.pos_) {
+           sub_oheaps_[0]->DummyAccess(enc_key);
+         } else {
+           sub_oheaps_[0]->Insert(moved[i].meta_.key_,
+                                  std::move(moved[i].val_), enc_key);
+         }
+       });
   --capacity_;
   memory_access_count_ += SubOHeapsMemoryAccessCountSum() - start_accesses;
   memory_bytes_moved_total_ +=
       SubOHeapsMemoryBytesMovedTotalSum() - start_bytes;
 
-  if (IsPowerOfTwo(capacity_)) {
+  if (steps_.IsStep(capacity_)) {
+    assert(sub_oheaps_[1]->Size() == 0);
     sub_oheaps_[1] = std::move(sub_oheaps_[0]);
     if (capacity_ > 1) {
-      sub_oheaps_[0] = std::make_unique<POHeap>(capacity_ / 2, val_len_);
+      sub_oheaps_[0] = NewSubOHeap(steps_.Below(capacity_));
     } else {
       sub_oheaps_[0] = nullptr;
     }
   }
 }
 
+// Same layout as the dynamic OMap's Resize; the larger sub-heap takes any
+// MovesPerGrow(s) * j blocks, as their order does not matter.
+uint64_t OHeap::Resize(size_t n, crypto::Key enc_key) {
+  auto lock = Foreground(enc_key);
+  assert(size_ <= n);
+  auto start_accesses = SubOHeapsMemoryAccessCountSum();
+  auto start_bytes = SubOHeapsMemoryBytesMovedTotalSum();
+  std::array<std::vector<Block>, 2> taken;
+  pool_.ParallelFor(2, [&](size_t i) {
+    if (sub_oheaps_[i] != nullptr)
+      taken[i] = sub_oheaps_[i]->TakeAll(enc_key);
+  });
+  std::vector<Block> blocks = std::move(taken[0]);
+  std::move(taken[1].begin(), taken[1].end(), std::back_inserter(blocks));
+  uint64_t accesses = SubOHeapsMemoryAccessCountSum() - start_accesses;
+  uint64_t bytes = SubOHeapsMemoryBytesMovedTotalSum() - start_bytes;
+  for (auto &so : sub_oheaps_)
+    so.reset();
+
+  capacity_ = n;
+  // The capacity of each new sub-heap (0: none), and its blocks.
+  std::array<size_t, 2> caps{0, n};
+  std::array<std::vector<Block>, 2> parts;
+  if (n > 1) {
+    size_t s = steps_.Below(n);
+    caps = {s, steps_.Above(s)};
+    size_t split =
+        blocks.size() - std::min(blocks.size(), MovesPerGrow(s) * (n - s));
+    parts[0].assign(std::make_move_iterator(blocks.begin()),
+                    std::make_move_iterator(blocks.begin() + split));
+    blocks.erase(blocks.begin(), blocks.begin() + split);
+  }
+  parts[1] = std::move(blocks);
+  pool_.ParallelFor(2, [&](size_t i) {
+    if (!caps[i])
+      return;
+    sub_oheaps_[i] = NewSubOHeap(caps[i]);
+    sub_oheaps_[i]->BulkLoad(std::move(parts[i]), enc_key);
+  });
+  accesses += SubOHeapsMemoryAccessCountSum();
+  bytes += SubOHeapsMemoryBytesMovedTotalSum();
+  memory_access_count_ += accesses;
+  memory_bytes_moved_total_ += bytes;
+  return bytes;
+}
+
+uint64_t OHeap::Reserve(size_t n, crypto::Key enc_key) {
+  auto lock = Foreground(enc_key);
+  return n > capacity_ ? Resize(n, enc_key) : 0;
+}
+
 void OHeap::Insert(Key k, Val v, crypto::Key enc_key, bool pad) {
+  auto lock = Foreground(enc_key);
   assert(size_ < capacity_);
   auto start_accesses = SubOHeapsMemoryAccessCountSum();
   auto start_bytes = SubOHeapsMemoryBytesMovedTotalSum();
-  sub_oheaps_[1]->Insert(k, std::move(v), enc_key);
+  size_t target = InsertIntoSmaller() ? 0 : 1;
+  // Padded, each sub-heap gets one insert or dummy access, then one more
+  // dummy.
+  pool_.ParallelFor(2, [&](size_t i) {
+    if (sub_oheaps_[i] == nullptr)
+      return;
+    if (i == target)
+      sub_oheaps_[i]->Insert(k, std::move(v), enc_key);
+    else if (pad)
+      sub_oheaps_[i]->DummyAccess(enc_key);
+    if (pad)
+      sub_oheaps_[i]->DummyAccess(enc_key);
+  });
   ++size_;
-  if (!pad) {
-    memory_access_count_ += SubOHeapsMemoryAccessCountSum() - start_accesses;
-    memory_bytes_moved_total_ +=
-        SubOHeapsMemoryBytesMovedTotalSum() - start_bytes;
-    return;
-  }
-
-  for (auto &so : sub_oheaps_) {
-    if (so != nullptr)
-      so->DummyAccess(enc_key);
-  }
   memory_access_count_ += SubOHeapsMemoryAccessCountSum() - start_accesses;
   memory_bytes_moved_total_ +=
       SubOHeapsMemoryBytesMovedTotalSum() - start_bytes;
 }
 
+void OHeap::StartMigrator() {
+  if (!grow_ahead_)
+    return;
+  migrator_.Start(
+      [this] { return has_migrate_key_ && capacity_ < size_ + grow_ahead_; },
+      [this] { Grow(migrate_key_); });
+}
+
+utils::BackgroundMigrator::Lock OHeap::Foreground(
+    const crypto::Key &enc_key) {
+  auto lock = migrator_.Foreground();
+  migrate_key_ = enc_key;
+  has_migrate_key_ = true;
+  return lock;
+}
+
+std::unique_ptr<POHeap> OHeap::NewSubOHeap(size_t n) {
+  return std::make_unique<POHeap>(n, val_len_, &store_pool_);
+}
+
+void OHeap::Move(size_t count, const std::function<void(size_t)> &take,
+                 const std::function<void(size_t)> &put) {
+  take(0);
+  for (size_t j = 1; j < count; ++j)
+    pool_.ParallelFor(2, [&](size_t i) {
+      if (i)
+        put(j - 1);
+      else
+        take(j);
+    });
+  put(count - 1);
+}
+
+// Same bounds as in the dynamic OMap, see its InsertIntoSmaller.
+bool OHeap::InsertIntoSmaller() const {
+  if (sub_oheaps_[0] == nullptr || steps_.IsStep(capacity_))
+    return false;
+  size_t s = sub_oheaps_[0]->Capacity();
+  return sub_oheaps_[1]->Size() >= MovesPerGrow(s) * (capacity_ - s);
+}
+
 Block OHeap::FindMin(crypto::Key enc_key, bool pad) {
+  auto lock = Foreground(enc_key);
   if (!size_)
     return Block(true);
 
   auto start_accesses = SubOHeapsMemoryAccessCountSum();
   auto start_bytes = SubOHeapsMemoryBytesMovedTotalSum();
+  std::array<Block, 2> so_bls{Block(true), Block(true)};
+  pool_.ParallelFor(2, [&](size_t i) {
+    if (sub_oheaps_[i] == nullptr)
+      return;
+    // Skip the first sub structure if it's known to be empty
+    // (steps_.IsStep(capacity_)).
+    if (i == 1 || !steps_.IsStep(capacity_))
+      so_bls[i] = sub_oheaps_[i]->FindMin(enc_key, pad);
+    if (pad) // Else no need to hide what was done.
+      sub_oheaps_[i]->DummyAccess(enc_key);
+  });
   Block res(true);
-  for (int i = 0; i < 2; ++i) {
-    // Skip the first sub structure if 1. it's null (size==1) or it's known to
-    // be empty (IsPowerOfTwo(capacity_)).
-    if (i == 0 && (sub_oheaps_[i] == nullptr || IsPowerOfTwo(capacity_)))
-      continue;
-    auto so_bl = sub_oheaps_[i]->FindMin(enc_key, pad);
+  for (auto &so_bl : so_bls)
     if (so_bl.meta_.pos_
         && (!res.meta_.pos_
             || so_bl.meta_.key_ < res.meta_.key_))
       res = std::move(so_bl);
-  }
-
-  if (!pad) { // No need to hide what was done
-    memory_access_count_ += SubOHeapsMemoryAccessCountSum() - start_accesses;
-    memory_bytes_moved_total_ +=
-        SubOHeapsMemoryBytesMovedTotalSum() - start_bytes;
-    return res;
-  }
-
-  for (auto &so : sub_oheaps_) {
-    if (so != nullptr)
-      so->DummyAccess(enc_key);
-  }
   memory_access_count_ += SubOHeapsMemoryAccessCountSum() - start_accesses;
   memory_bytes_moved_total_ +=
       SubOHeapsMemoryBytesMovedTotalSum() - start_bytes;
@@ -159,38 +274,41 @@ Block OHeap::FindMin(crypto::Key enc_key, bool pad) {
 }
 
 Block OHeap::ExtractMin(crypto::Key enc_key) {
+  auto lock = Foreground(enc_key);
   if (!size_)
     return Block(true);
 
   auto start_accesses = SubOHeapsMemoryAccessCountSum();
   auto start_bytes = SubOHeapsMemoryBytesMovedTotalSum();
-  Block res(true);
-  int found_idx = -1;
-  for (int i = 0; i < 2; ++i) {
+  std::array<Block, 2> so_bls{Block(true), Block(true)};
+  pool_.ParallelFor(2, [&](size_t i) {
     // Skip the first sub structure if 1. it's null (size==1) or it's known to
-    // be empty (IsPowerOfTwo(capacity_)).
-    if (i == 0 && (sub_oheaps_[i] == nullptr || IsPowerOfTwo(capacity_)))
-      continue;
-    auto so_bl = sub_oheaps_[i]->FindMin(enc_key);
-    if (so_bl.meta_.pos_
+    // be empty (steps_.IsStep(capacity_)).
+    if (i == 0 && (sub_oheaps_[i] == nullptr || steps_.IsStep(capacity_)))
+      return;
+    so_bls[i] = sub_oheaps_[i]->FindMin(enc_key);
+  });
+  Block res(true);
+  size_t found_idx = 2;
+  for (size_t i = 0; i < 2; ++i) {
+    if (so_bls[i].meta_.pos_
         && (!res.meta_.pos_
-            || so_bl.meta_.key_ < res.meta_.key_)) {
-      res = std::move(so_bl);
+            || so_bls[i].meta_.key_ < res.meta_.key_)) {
+      res = std::move(so_bls[i]);
       found_idx = i;
     }
   }
 
-  for (int i = 0; i < 2; ++i) {
-    // Skip the first sub structure if 1. it's null (size==1) or it's known to
-    // be empty (IsPowerOfTwo(capacity_)).
-    if (i == 0 && (sub_oheaps_[i] == nullptr || IsPowerOfTwo(capacity_)))
-      continue;
+  pool_.ParallelFor(2, [&](size_t i) {
+    // Same skipping as above.
+    if (i == 0 && (sub_oheaps_[i] == nullptr || steps_.IsStep(capacity_)))
+      return;
     if (found_idx == i) {
       sub_oheaps_[i]->ExtractMin(enc_key);
     } else {
       sub_oheaps_[i]->DummyAccess(enc_key);
     }
-  }
+  });
   --size_;
   memory_access_count_ += SubOHeapsMemoryAccessCountSum() - start_accesses;
   memory_bytes_moved_total_ +=
@@ -199,6 +317,15 @@ Block OHeap::ExtractMin(crypto::Key enc_key) {
   return res;
 }
 
+bool OHeap::IsOnDisk() const {
+  auto lock = migrator_.Foreground();
+  bool res = false;
+  for (auto &so : sub_oheaps_)
+    if (so != nullptr)
+      res |= so->IsOnDisk();
+  return res;
+}
+
 uint64_t OHeap::SubOHeapsMemoryAccessCountSum() {
   unsigned long long res = 0;
   for (auto &so : sub_oheaps_) {
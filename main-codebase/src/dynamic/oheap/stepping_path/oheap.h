@@ -4,10 +4,18 @@
 #include <array>
 #include <cstddef>
 #include <cstdint>
+#include <functional>
 #include <memory>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "../../../static/oheap/path/oheap.h"
+#include "../../../store/store_pool.h"
+#include "../../../utils/background_migrator.h"
 #include "../../../utils/crypto.h"
+#include "../../../utils/growth_steps.h"
+#include "../../../utils/thread_pool.h"
 
 namespace dyno::dynamic_stepping_path_oheap {
 
@@ -16,30 +24,102 @@ using Block = static_path_oheap::Block;
 using Key = static_path_oheap::Key;
 using Val = static_path_oheap::Val;
 
+class Options {
+ public:
+  // Threads for the accesses an operation makes to each sub-heap; with 2 they
+  // run at the same time.
+  unsigned num_threads_ = 1;
+  // As the dynamic OMap's growth_factor: sub-heaps have the capacities of two
+  // consecutive utils::GrowthSteps.
+  double growth_factor_ = 2;
+  // As the dynamic ORAM's grow_ahead_: Grow runs in the background while
+  // Capacity() < Size() + grow_ahead_.
+  size_t grow_ahead_ = 0;
+};
+
+// As for the dynamic ORAM, sub-heap stores are recycled through a
+// store::StorePool, and with a path each sub-heap has its own file. With
+// Options::grow_ahead_, Grow steps also run between operations on a background
+// thread; Shrink stays with the caller.
 class OHeap {
  public:
-  OHeap(size_t val_len) : val_len_(val_len) {}
-  // Only implemented for benchmarks.
-  OHeap(int starting_size_power_of_two, size_t val_len);
+  OHeap(size_t val_len, Options opts = Options())
+      : OHeap(val_len, "", 0, opts) {}
+  // PosixSingleFile -- On file store error reverts to RAM store.
+  OHeap(size_t val_len, std::string path, uint8_t max_levels_in_mem,
+        Options opts = Options())
+      : val_len_(val_len),
+        steps_(opts.growth_factor_),
+        store_pool_(std::move(path), max_levels_in_mem),
+        pool_(opts.num_threads_),
+        grow_ahead_(opts.grow_ahead_) {
+    StartMigrator();
+  }
+  // Only implemented for benchmarks --- PosixSingleFile.
+  OHeap(int starting_size_power_of_two, size_t val_len, std::string path = "",
+        uint8_t max_levels_in_mem = 0, Options opts = Options());
+  // As for the dynamic OMap, Grow and Shrink each move up to MovesPerGrow
+  // blocks across (two by default), and Insert goes to the smaller sub-heap
+  // when the larger one would get too full for Shrink. Shrink needs
+  // Size() < Capacity().
   void Grow(crypto::Key enc_key);
   void Shrink(crypto::Key enc_key);
+  // As for the dynamic OMap: rebuilds both sub-heaps at capacity n in one
+  // pass each (needs Size() <= n), and returns the bytes moved.
+  uint64_t Resize(size_t n, crypto::Key enc_key);
+  // Resize(n) if n > Capacity(); else a no-op that returns 0.
+  uint64_t Reserve(size_t n, crypto::Key enc_key);
   void Insert(Key k, Val v, crypto::Key enc_key, bool pad = true);
   Block FindMin(crypto::Key enc_key, bool pad = true);
   Block ExtractMin(crypto::Key enc_key);
-  [[nodiscard]] size_t Capacity() const { return capacity_; }
-  [[nodiscard]] size_t Size() const { return size_; }
-  [[nodiscard]] uint64_t MemoryAccessCount() const { return memory_access_count_; }
-  [[nodiscard]] uint64_t MemoryBytesMovedTotal() const { return memory_bytes_moved_total_; }
+  [[nodiscard]] size_t Capacity() const {
+    auto lock = migrator_.Foreground();
+    return capacity_;
+  }
+  [[nodiscard]] size_t Size() const {
+    auto lock = migrator_.Foreground();
+    return size_;
+  }
+  [[nodiscard]] uint64_t MemoryAccessCount() const {
+    auto lock = migrator_.Foreground();
+    return memory_access_count_;
+  }
+  [[nodiscard]] uint64_t MemoryBytesMovedTotal() const {
+    auto lock = migrator_.Foreground();
+    return memory_bytes_moved_total_;
+  }
+  [[nodiscard]] bool IsOnDisk() const;
 
  private:
   size_t capacity_ = 0;
   const size_t val_len_;
   size_t size_ = 0;
+  const utils::GrowthSteps steps_;
+  store::StorePool store_pool_; // Outlives the sub-heaps.
   std::array<std::unique_ptr<POHeap>, 2> sub_oheaps_{};
+  utils::ThreadPool pool_; // Runs the per-sub-heap parts of an operation.
   uint64_t memory_access_count_ = 0;
   uint64_t memory_bytes_moved_total_ = 0;
+  std::unique_ptr<POHeap> NewSubOHeap(size_t n);
+  // The moves of Grow or Shrink: take(0), then take(i) alongside put(i - 1)
+  // for each following one, then put(count - 1).
+  void Move(size_t count, const std::function<void(size_t)> &take,
+            const std::function<void(size_t)> &put);
+  // Between the step s and the next one.
+  [[nodiscard]] size_t MovesPerGrow(size_t s) const {
+    return steps_.MovesToEmpty(s) + 1;
+  }
+  [[nodiscard]] bool InsertIntoSmaller() const;
   uint64_t SubOHeapsMemoryAccessCountSum();
   uint64_t SubOHeapsMemoryBytesMovedTotalSum();
+  const size_t grow_ahead_;
+  crypto::Key migrate_key_{};
+  bool has_migrate_key_ = false;
+  // Last, so that it stops before the sub-heaps go.
+  utils::BackgroundMigrator migrator_;
+  void StartMigrator();
+  // Locks out the migrator for the operation, and records its key.
+  utils::BackgroundMigrator::Lock Foreground(const crypto::Key &enc_key);
 };
 } // namespace dyno::dynamic_stepping_path_oheap
 
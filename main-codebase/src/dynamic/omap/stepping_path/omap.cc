@@ -1,67 +1,91 @@
 #include "omap.h"
 
+#include <algorithm>
+#include <array>
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
+#include <functional>
+#include <iterator>
 #include <memory>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "../../../static/omap/path_avl/omap.h"
+#include "../../../static/omap/path_bplus/omap.h"
 #include "../../../utils/crypto.h"
+#include "../../../utils/fixed_bytes.h"
 
 namespace dyno::dynamic_stepping_path_omap {
 
-namespace {
-bool IsPowerOfTwo(size_t x) {
-  return !(x & (x - 1));
-}
-} // namespace
-
-OMap::OMap(int starting_size_power_of_two, size_t val_len,
-           std::string path, uint8_t max_levels_in_mem)
+template<typename StaticOMap>
+BasicOMap<StaticOMap>::BasicOMap(int starting_size_power_of_two,
+                                 size_t val_len, std::string path,
+                                 uint8_t max_levels_in_mem, Options opts,
+                                 unsigned num_threads, double growth_factor,
+                                 size_t grow_ahead)
     : capacity_(1UL << starting_size_power_of_two),
       val_len_(val_len),
       size_(1UL << starting_size_power_of_two),
       store_path_(std::move(path)),
-      max_mem_level_(max_levels_in_mem) {
-  auto base_cap = capacity_ >> 1;
-  if (capacity_)
-    for (int i = 0; i < 2; ++i)
-      sub_omaps_[i] = std::make_unique<POMap>(base_cap << i, val_len_,
-                                              store_path_, max_mem_level_);
+      store_pool_(store_path_, max_levels_in_mem),
+      max_mem_level_(max_levels_in_mem),
+      opts_(WithStorePool(opts, &store_pool_)),
+      steps_(growth_factor),
+      pool_(num_threads),
+      grow_ahead_(grow_ahead) {
+  std::array<size_t, 2> caps{};
+  if (capacity_) {
+    caps[0] = steps_.Below(capacity_);
+    caps[1] = steps_.Above(caps[0]);
+  }
+  for (int i = 0; i < 2; ++i)
+    if (caps[i])
+      sub_omaps_[i] = std::make_unique<StaticOMap>(
+          caps[i], val_len_, store_path_, max_mem_level_, opts_);
+  StartMigrator();
 }
 
-void OMap::Grow(crypto::Key enc_key) {
+template<typename StaticOMap>
+void BasicOMap<StaticOMap>::Grow(crypto::Key enc_key) {
+  auto lock = Foreground(enc_key);
   if (capacity_ == 0) {
-    sub_omaps_[1] = std::make_unique<POMap>(1, val_len_,
-                                            store_path_, max_mem_level_);
+    sub_omaps_[1] = std::make_unique<StaticOMap>(
+        1, val_len_, store_path_, max_mem_level_, opts_);
     ++capacity_;
     return;
   }
 
-  if (IsPowerOfTwo(capacity_)) {
+  if (steps_.IsStep(capacity_)) {
     assert(sub_omaps_[1] != nullptr);
     sub_omaps_[0] = std::move(sub_omaps_[1]);
-    sub_omaps_[1] = std::make_unique<POMap>(2 * capacity_, val_len_,
-                                            store_path_, max_mem_level_);
+    sub_omaps_[1] = std::make_unique<StaticOMap>(
+        steps_.Above(capacity_), val_len_, store_path_, max_mem_level_, opts_);
   }
 
   assert(sub_omaps_[0] != nullptr && sub_omaps_[1] != nullptr);
   auto start_accesses = SubOMapsMemoryAccessCountSum();
   auto start_bytes = SubOMapsMemoryBytesMovedTotalSum();
-  auto move_kv = sub_omaps_[0]->TakeOne(enc_key);
-  if (!move_kv.key_ && !move_kv.val_) {
-    sub_omaps_[1]->Read(0, enc_key); // Dummy
-  } else {
-    sub_omaps_[1]->Insert(move_kv.key_, std::move(move_kv.val_), enc_key);
-  }
+  size_t moves = MovesPerGrow(sub_omaps_[0]->Capacity());
+  std::vector<KeyValPair> moved(moves);
+  Move(moves, [&](size_t i) { moved[i] = sub_omaps_[0]->TakeOne(enc_key); },
+       [&](size_t i) {
+         if (moved[i].key_ == Key() && !moved[i].val_) {
+           sub_omaps_[1]->Dummy(Op::kInsert, enc_key);
+         } else {
+           sub_omaps_[1]->Insert(moved[i].key_, std::move(moved[i].val_),
+                                 enc_key);
+         }
+       });
   ++capacity_;
   memory_access_count_ += SubOMapsMemoryAccessCountSum() - start_accesses;
   memory_bytes_moved_total_ += SubOMapsMemoryBytesMovedTotalSum() - start_bytes;
 }
 
-void OMap::Shrink(crypto::Key enc_key) {
+template<typename StaticOMap>
+void BasicOMap<StaticOMap>::Shrink(crypto::Key enc_key) {
+  auto lock = Foreground(enc_key);
   if (capacity_ == 0)
     return;
 
@@ -78,82 +102,179 @@ void OMap::Shrink(crypto::Key enc_key) {
   assert(sub_omaps_[0] != nullptr && sub_omaps_[1] != nullptr);
   auto start_accesses = SubOMapsMemoryAccessCountSum();
   auto start_bytes = SubOMapsMemoryBytesMovedTotalSum();
-  for (int i = 0; i < 2; ++i) {
-    KeyValPair move_kv(0, nullptr);
-    if (sub_omaps_[0]->Size() < sub_omaps_[0]->Capacity()) {
-      move_kv = sub_omaps_[1]->TakeOne(enc_key);
-    } else {
-      sub_omaps_[1]->Read(0, enc_key); // Dummy
-    }
-    if (!move_kv.key_ && !move_kv.val_) {
-      sub_omaps_[0]->Read(0, enc_key); // Dummy
-    } else {
-      sub_omaps_[0]->Insert(move_kv.key_, std::move(move_kv.val_), enc_key);
-    }
-  }
+  // Only as many pairs as the smaller one has room for are taken; its size is
+  // not read during the moves, as it may be taking the first one.
+  size_t room = sub_omaps_[0]->Capacity() - sub_omaps_[0]->Size();
+  size_t moves = MovesPerGrow(sub_omaps_[0]->Capacity());
+  std::vector<KeyValPair> moved(moves);
+  Move(moves,
+       [&](size_t i) {
+         moved[i] = KeyValPair(Key(), nullptr);
+         if (room) {
+           moved[i] = sub_omaps_[1]->TakeOne(enc_key);
+           if (moved[i].key_ != Key() || moved[i].val_)
+             --room;
+         } else {
+           sub_omaps_[1]->Dummy(Op::kDelete, enc_key);
+         }
+       },
+       [&](size_t i) {
+         if (moved[i].key_ == Key() && !moved[i].val_) {
+           sub_omaps_[0]->Dummy(Op::kInsert, enc_key);
+         } else {
+           sub_omaps_[0]->Insert(moved[i].key_, std::move(moved[i].val_),
+                                 enc_key);
+         }
+       });
   --capacity_;
   memory_access_count_ += SubOMapsMemoryAccessCountSum() - start_accesses;
   memory_bytes_moved_total_ += SubOMapsMemoryBytesMovedTotalSum() - start_bytes;
 
-  if (IsPowerOfTwo(capacity_)) {
+  if (steps_.IsStep(capacity_)) {
+    assert(sub_omaps_[1]->Size() == 0);
     sub_omaps_[1] = std::move(sub_omaps_[0]);
-    size_t smaller_size = capacity_ / 2;
+    size_t smaller_size = steps_.Below(capacity_);
     if (smaller_size) {
       sub_omaps_[0] =
-          std::make_unique<POMap>(capacity_ / 2, val_len_,
-                                  store_path_, max_mem_level_);
+          std::make_unique<StaticOMap>(smaller_size, val_len_, store_path_,
+                                       max_mem_level_, opts_);
     } else {
       sub_omaps_[0].reset();
     }
   }
 }
 
-void OMap::Insert(Key key, Val val, crypto::Key enc_key) {
+// The sub-structures are built at the sizes Grow leaves at capacity n = s + j,
+// for the step s below n and 0 < j <= t - s up to the next step t: s and t,
+// the larger one with the last (up to) MovesPerGrow(s) * j pairs, see
+// InsertIntoSmaller.
+template<typename StaticOMap>
+uint64_t BasicOMap<StaticOMap>::Resize(size_t n, crypto::Key enc_key) {
+  auto lock = Foreground(enc_key);
+  assert(size_ <= n);
+  auto start_accesses = SubOMapsMemoryAccessCountSum();
+  auto start_bytes = SubOMapsMemoryBytesMovedTotalSum();
+  std::array<std::vector<KeyValPair>, 2> taken;
+  pool_.ParallelFor(2, [&](size_t i) {
+    if (sub_omaps_[i] != nullptr)
+      taken[i] = sub_omaps_[i]->TakeAll(enc_key);
+  });
+  std::vector<KeyValPair> kvs;
+  for (auto &so_kvs : taken) {
+    std::vector<KeyValPair> merged;
+    merged.reserve(kvs.size() + so_kvs.size());
+    std::merge(std::make_move_iterator(kvs.begin()),
+               std::make_move_iterator(kvs.end()),
+               std::make_move_iterator(so_kvs.begin()),
+               std::make_move_iterator(so_kvs.end()),
+               std::back_inserter(merged),
+               [](const KeyValPair &a, const KeyValPair &b) {
+                 return a.key_ < b.key_;
+               });
+    kvs = std::move(merged);
+  }
+  uint64_t accesses = SubOMapsMemoryAccessCountSum() - start_accesses;
+  uint64_t bytes = SubOMapsMemoryBytesMovedTotalSum() - start_bytes;
+  for (auto &so : sub_omaps_)
+    so.reset(); // Before the new ones open the same store path.
+
+  capacity_ = n;
+  // The capacity of each new sub-structure (0: none), and its pairs.
+  std::array<size_t, 2> caps{0, n};
+  std::array<std::vector<KeyValPair>, 2> parts;
+  if (n > 1) {
+    size_t s = steps_.Below(n);
+    caps = {s, steps_.Above(s)};
+    size_t split =
+        kvs.size() - std::min(kvs.size(), MovesPerGrow(s) * (n - s));
+    parts[0].assign(std::make_move_iterator(kvs.begin()),
+                    std::make_move_iterator(kvs.begin() + split));
+    kvs.erase(kvs.begin(), kvs.begin() + split);
+  }
+  parts[1] = std::move(kvs);
+  pool_.ParallelFor(2, [&](size_t i) {
+    if (caps[i])
+      sub_omaps_[i] = std::make_unique<StaticOMap>(
+          caps[i], val_len_, std::move(parts[i]), enc_key, store_path_,
+          max_mem_level_, opts_);
+  });
+  accesses += SubOMapsMemoryAccessCountSum();
+  bytes += SubOMapsMemoryBytesMovedTotalSum();
+  memory_access_count_ += accesses;
+  memory_bytes_moved_total_ += bytes;
+  return bytes;
+}
+
+template<typename StaticOMap>
+uint64_t BasicOMap<StaticOMap>::Reserve(size_t n, crypto::Key enc_key) {
+  auto lock = Foreground(enc_key);
+  return n > capacity_ ? Resize(n, enc_key) : 0;
+}
+
+template<typename StaticOMap>
+void BasicOMap<StaticOMap>::Insert(Key key, Val val, crypto::Key enc_key) {
+  auto lock = Foreground(enc_key);
   assert(size_ < capacity_);
   auto start_accesses = SubOMapsMemoryAccessCountSum();
   auto start_bytes = SubOMapsMemoryBytesMovedTotalSum();
   size_t pre_size = TotalSizeOfSubOmaps();
-  if (sub_omaps_[0] != nullptr) // Corner case: capacity = 1
-    sub_omaps_[0]->ReadAndRemove(key, enc_key);
-  sub_omaps_[1]->Insert(key, std::move(val), enc_key);
+  // Either way one sub-structure gets an insert and the other a delete. With
+  // opts_.pad_per_op_, the kinds of the accesses tell which one took the pair.
+  size_t target = InsertIntoSmaller() ? 0 : 1;
+  pool_.ParallelFor(2, [&](size_t i) {
+    if (sub_omaps_[i] == nullptr) // Corner case: capacity = 1
+      return;
+    if (i == target)
+      sub_omaps_[i]->Insert(key, std::move(val), enc_key);
+    else
+      sub_omaps_[i]->ReadAndRemove(key, enc_key);
+  });
   if (TotalSizeOfSubOmaps() > pre_size)
     ++size_; // Else it was a pre-existing key
   memory_access_count_ += SubOMapsMemoryAccessCountSum() - start_accesses;
   memory_bytes_moved_total_ += SubOMapsMemoryBytesMovedTotalSum() - start_bytes;
 }
 
-Val OMap::Read(Key key, crypto::Key enc_key) {
+template<typename StaticOMap>
+Val BasicOMap<StaticOMap>::Read(Key key, crypto::Key enc_key) {
+  auto lock = Foreground(enc_key);
   Val res;
   auto start_accesses = SubOMapsMemoryAccessCountSum();
   auto start_bytes = SubOMapsMemoryBytesMovedTotalSum();
-  for (int i = 0; i < 2; ++i) {
+  std::array<Val, 2> so_vals;
+  pool_.ParallelFor(2, [&](size_t i) {
     // Skip the first sub structure if 1. it's null (size==1) or it's known to
-    // be empty (IsPowerOfTwo(capacity_)).
-    if (i == 0 && (sub_omaps_[i] == nullptr || IsPowerOfTwo(capacity_)))
-      continue;
-    auto so_val = sub_omaps_[i]->Read(key, enc_key);
+    // be empty (steps_.IsStep(capacity_)).
+    if (i == 0 && (sub_omaps_[i] == nullptr || steps_.IsStep(capacity_)))
+      return;
+    so_vals[i] = sub_omaps_[i]->Read(key, enc_key);
+  });
+  for (auto &so_val : so_vals)
     if (so_val)
-      res = std::move(so_val); // ≤1 so_res is valid.
-  }
+      res = std::move(so_val); // ≤1 so_val is valid.
   memory_access_count_ += SubOMapsMemoryAccessCountSum() - start_accesses;
   memory_bytes_moved_total_ += SubOMapsMemoryBytesMovedTotalSum() - start_bytes;
   return res;
 }
 
-Val OMap::ReadAndRemove(Key key, crypto::Key enc_key) {
+template<typename StaticOMap>
+Val BasicOMap<StaticOMap>::ReadAndRemove(Key key, crypto::Key enc_key) {
+  auto lock = Foreground(enc_key);
   size_t pre_size = TotalSizeOfSubOmaps();
   Val res;
   auto start_accesses = SubOMapsMemoryAccessCountSum();
   auto start_bytes = SubOMapsMemoryBytesMovedTotalSum();
-  for (int i = 0; i < 2; ++i) {
+  std::array<Val, 2> so_vals;
+  pool_.ParallelFor(2, [&](size_t i) {
     // Skip the first sub structure if 1. it's null (size==1) or it's known to
-    // be empty (IsPowerOfTwo(capacity_)).
-    if (i == 0 && (sub_omaps_[i] == nullptr || IsPowerOfTwo(capacity_)))
-      continue;
-    auto so_val = sub_omaps_[i]->ReadAndRemove(key, enc_key);
+    // be empty (steps_.IsStep(capacity_)).
+    if (i == 0 && (sub_omaps_[i] == nullptr || steps_.IsStep(capacity_)))
+      return;
+    so_vals[i] = sub_omaps_[i]->ReadAndRemove(key, enc_key);
+  });
+  for (auto &so_val : so_vals)
     if (so_val)
-      res = std::move(so_val); // ≤1 so_res is valid.
-  }
+      res = std::move(so_val); // ≤1 so_val is valid.
   if (TotalSizeOfSubOmaps() < pre_size)
     --size_;
   memory_access_count_ += SubOMapsMemoryAccessCountSum() - start_accesses;
@@ -161,7 +282,96 @@ Val OMap::ReadAndRemove(Key key, crypto::Key enc_key) {
   return res;
 }
 
-size_t OMap::TotalSizeOfSubOmaps() const {
+template<typename StaticOMap>
+std::vector<typename StaticOMap::KeyValPair> BasicOMap<StaticOMap>::RangeScan(
+    Key lo, Key hi, size_t max_results, crypto::Key enc_key) {
+  auto lock = Foreground(enc_key);
+  std::vector<KeyValPair> res;
+  auto start_accesses = SubOMapsMemoryAccessCountSum();
+  auto start_bytes = SubOMapsMemoryBytesMovedTotalSum();
+  std::array<std::vector<KeyValPair>, 2> so_results;
+  pool_.ParallelFor(2, [&](size_t i) {
+    // Same skipping as in Read.
+    if (i == 0 && (sub_omaps_[i] == nullptr || steps_.IsStep(capacity_)))
+      return;
+    so_results[i] = sub_omaps_[i]->RangeScan(lo, hi, max_results, enc_key);
+  });
+  for (auto &so_res : so_results) {
+    std::vector<KeyValPair> merged;
+    merged.reserve(res.size() + so_res.size());
+    // A key is in at most one sub-structure.
+    std::merge(std::make_move_iterator(res.begin()),
+               std::make_move_iterator(res.end()),
+               std::make_move_iterator(so_res.begin()),
+               std::make_move_iterator(so_res.end()),
+               std::back_inserter(merged),
+               [](const KeyValPair &a, const KeyValPair &b) {
+                 return a.key_ < b.key_;
+               });
+    res = std::move(merged);
+  }
+  if (res.size() > max_results)
+    res.resize(max_results);
+  memory_access_count_ += SubOMapsMemoryAccessCountSum() - start_accesses;
+  memory_bytes_moved_total_ += SubOMapsMemoryBytesMovedTotalSum() - start_bytes;
+  return res;
+}
+
+// Same sub-structure operations as the real operation of kind `op`.
+template<typename StaticOMap>
+void BasicOMap<StaticOMap>::Dummy(Op op, crypto::Key enc_key) {
+  auto lock = Foreground(enc_key);
+  assert(capacity_ > 0);
+  auto start_accesses = SubOMapsMemoryAccessCountSum();
+  auto start_bytes = SubOMapsMemoryBytesMovedTotalSum();
+  pool_.ParallelFor(2, [&](size_t i) {
+    if (op == Op::kInsert) {
+      if (sub_omaps_[i] != nullptr)
+        sub_omaps_[i]->Dummy(i ? Op::kInsert : Op::kDelete, enc_key);
+    } else if (i == 1
+        || (sub_omaps_[i] != nullptr && !steps_.IsStep(capacity_))) {
+      sub_omaps_[i]->Dummy(op, enc_key);
+    }
+  });
+  memory_access_count_ += SubOMapsMemoryAccessCountSum() - start_accesses;
+  memory_bytes_moved_total_ += SubOMapsMemoryBytesMovedTotalSum() - start_bytes;
+}
+
+template<typename StaticOMap>
+void BasicOMap<StaticOMap>::Move(size_t count,
+                                 const std::function<void(size_t)> &take,
+                                 const std::function<void(size_t)> &put) {
+  take(0);
+  for (size_t j = 1; j < count; ++j)
+    pool_.ParallelFor(2, [&](size_t i) {
+      if (i)
+        put(j - 1);
+      else
+        take(j);
+    });
+  put(count - 1);
+}
+
+template<typename StaticOMap>
+void BasicOMap<StaticOMap>::StartMigrator() {
+  if (!grow_ahead_)
+    return;
+  migrator_.Start(
+      [this] { return has_migrate_key_ && capacity_ < size_ + grow_ahead_; },
+      [this] { Grow(migrate_key_); });
+}
+
+template<typename StaticOMap>
+utils::BackgroundMigrator::Lock BasicOMap<StaticOMap>::Foreground(
+    const crypto::Key &enc_key) {
+  auto lock = migrator_.Foreground();
+  migrate_key_ = enc_key;
+  has_migrate_key_ = true;
+  return lock;
+}
+
+template<typename StaticOMap>
+size_t BasicOMap<StaticOMap>::TotalSizeOfSubOmaps() const {
   size_t res = 0;
   for (auto &so : sub_omaps_)
     if (so != nullptr)
@@ -169,12 +379,29 @@ size_t OMap::TotalSizeOfSubOmaps() const {
   return res;
 }
 
-size_t OMap::Size() const {
+// With capacity s + j between steps s and t, 0 < j <= d = t - s, and
+// m = MovesPerGrow(s), the larger sub-structure holds at most mj pairs and the
+// smaller at most m(d - j): then m moves per Shrink (or Grow) empty the larger
+// (or smaller) one by the next step. A pair fits in the larger one unless it
+// holds mj already; then the smaller one has room, as Size() < Capacity() and
+// md >= s + d. With factor 2, m = 2 and d = s.
+template<typename StaticOMap>
+bool BasicOMap<StaticOMap>::InsertIntoSmaller() const {
+  if (sub_omaps_[0] == nullptr || steps_.IsStep(capacity_))
+    return false;
+  size_t s = sub_omaps_[0]->Capacity();
+  return sub_omaps_[1]->Size() >= MovesPerGrow(s) * (capacity_ - s);
+}
+
+template<typename StaticOMap>
+size_t BasicOMap<StaticOMap>::Size() const {
+  auto lock = migrator_.Foreground();
   assert(size_ == TotalSizeOfSubOmaps());
   return size_;
 }
 
-uint64_t OMap::SubOMapsMemoryAccessCountSum() const {
+template<typename StaticOMap>
+uint64_t BasicOMap<StaticOMap>::SubOMapsMemoryAccessCountSum() const {
   unsigned long long res = 0;
   for (auto &so : sub_omaps_) {
     if (so != nullptr) {
@@ -184,7 +411,8 @@ uint64_t OMap::SubOMapsMemoryAccessCountSum() const {
   return res;
 }
 
-uint64_t OMap::SubOMapsMemoryBytesMovedTotalSum() const {
+template<typename StaticOMap>
+uint64_t BasicOMap<StaticOMap>::SubOMapsMemoryBytesMovedTotalSum() const {
   unsigned long long res = 0;
   for (auto &so : sub_omaps_) {
     if (so != nullptr) {
@@ -194,10 +422,23 @@ uint64_t OMap::SubOMapsMemoryBytesMovedTotalSum() const {
   return res;
 }
 
-bool OMap::IsOnDisk() const {
+template<typename StaticOMap>
+bool BasicOMap<StaticOMap>::IsOnDisk() const {
+  auto lock = migrator_.Foreground();
   bool res = false;
   for (auto &so : sub_omaps_)
-    res |= so->IsOnDisk();
+    if (so != nullptr)
+      res |= so->IsOnDisk();
   return res;
 }
+
+template class BasicOMap<static_path_omap::OMap>;
+template class BasicOMap<static_path_bplus_omap::OMap>;
+template class BasicOMap<static_path_omap::BasicOMap<uint64_t>>;
+template class BasicOMap<static_path_omap::BasicOMap<bytes::FixedBytes<16>>>;
+template class BasicOMap<static_path_omap::BasicOMap<bytes::FixedBytes<32>>>;
+template class BasicOMap<
+    static_path_omap::BasicOMap<bytes::FixedBytes<16, true>>>;
+template class BasicOMap<
+    static_path_omap::BasicOMap<bytes::FixedBytes<32, true>>>;
 } // dyno::dynamic_stepping_path_omap
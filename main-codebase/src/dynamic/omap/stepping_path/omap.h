@@ -4,41 +4,118 @@
 #include <array>
 #include <cstddef>
 #include <cstdint>
+#include <functional>
 #include <memory>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "../../../static/omap/path_avl/omap.h"
+#include "../../../static/omap/path_bplus/omap.h"
+#include "../../../store/store_pool.h"
+#include "../../../utils/background_migrator.h"
 #include "../../../utils/crypto.h"
+#include "../../../utils/growth_steps.h"
+#include "../../../utils/thread_pool.h"
 
 namespace dyno::dynamic_stepping_path_omap {
 
-using POMap = static_path_omap::OMap;
-
 using Key = static_path_omap::Key;
 using Val = static_path_omap::Val;
 using KeyValPair = static_path_omap::KeyValPair;
+using Op = static_path_omap::Op;
+using Options = static_path_omap::Options;
 
-class OMap {
+// StaticOMap is the static map each sub-structure uses; it must have the
+// interface of static_path_omap::OMap, and gives the key type. Instantiated
+// for the B+-tree map and the AVL map with every key type it supports, see
+// the aliases below.
+//
+// With num_threads = 2 the two sub-structures, which share nothing, are
+// accessed at the same time, so an operation takes about as long as the
+// slower of its two halves; Grow and Shrink overlap each pair's removal with
+// the previous one's insertion.
+//
+// The sub-structures have the capacities of two consecutive steps of
+// utils::GrowthSteps(growth_factor): s and 2s by default. A smaller factor
+// lowers the memory kept beside the pairs, (1 + growth_factor) times the
+// capacity right after a step, for about 1 / (growth_factor - 1) times as many
+// moves per Grow and Shrink.
+//
+// With grow_ahead = h > 0, a background thread runs Grow while
+// Capacity() < Size() + h, using the key of the latest operation (see
+// utils::BackgroundMigrator), so a burst of up to h inserts finds the capacity
+// ready. Each step makes the same accesses as an explicit Grow, and when one
+// runs depends on Size() as when the caller grows on demand. Shrink stays with
+// the caller.
+template<typename StaticOMap>
+class BasicOMap {
  public:
-  // PosixSingleFile -- On file store reverts to RAM store.
-  explicit OMap(size_t val_len, std::string path = "",
-                uint8_t max_levels_in_mem = 0)
+  using Key = typename StaticOMap::Key;
+  using KeyValPair = typename StaticOMap::KeyValPair;
+
+  // PosixSingleFile, one file per sub-structure (path.0, path.1, ...) -- On
+  // file store error reverts to RAM store. Sub-structure stores come from a
+  // store::StorePool, so the one released at a step is resized for the next
+  // one instead of allocating anew. `opts` is passed on to every
+  // sub-structure, with the pool.
+  explicit BasicOMap(size_t val_len, std::string path = "",
+                     uint8_t max_levels_in_mem = 0, Options opts = Options(),
+                     unsigned num_threads = 1, double growth_factor = 2,
+                     size_t grow_ahead = 0)
       : val_len_(val_len),
         store_path_(std::move(path)),
-        max_mem_level_(max_levels_in_mem) {}
+        store_pool_(store_path_, max_levels_in_mem),
+        max_mem_level_(max_levels_in_mem),
+        opts_(WithStorePool(opts, &store_pool_)),
+        steps_(growth_factor),
+        pool_(num_threads),
+        grow_ahead_(grow_ahead) {
+    StartMigrator();
+  }
   // Only implemented for benchmarks --- PosixSingleFile.
-  OMap(int starting_size_power_of_two, size_t val_len,
-       std::string path = "", uint8_t max_levels_in_mem = 0);
+  BasicOMap(int starting_size_power_of_two, size_t val_len,
+            std::string path = "", uint8_t max_levels_in_mem = 0,
+            Options opts = Options(), unsigned num_threads = 1,
+            double growth_factor = 2, size_t grow_ahead = 0);
+  // Grow and Shrink each move up to MovesPerGrow pairs across (two by
+  // default), which keeps the sub-structure that is emptied at the next step
+  // (either way) small enough to be empty in time; Insert goes to the smaller
+  // one when the larger one would get too full for Shrink. Shrink needs
+  // Size() < Capacity().
   void Grow(crypto::Key enc_key);
   void Shrink(crypto::Key enc_key);
+  // Goes straight to the layout Grow or Shrink would reach at capacity n
+  // (needs Size() <= n): both sub-structures are read out once (TakeAll), and
+  // the new ones bulk built from the merged pairs, the larger one taking as
+  // many as Shrink allows. The cost only depends on the old and new
+  // capacities. Returns the bytes moved, which are also added to
+  // MemoryBytesMovedTotal().
+  uint64_t Resize(size_t n, crypto::Key enc_key);
+  // Resize(n) if n > Capacity(); else a no-op that returns 0.
+  uint64_t Reserve(size_t n, crypto::Key enc_key);
   void Insert(Key k, Val v, crypto::Key enc_key);
   Val Read(Key k, crypto::Key enc_key);
   Val ReadAndRemove(Key k, crypto::Key enc_key);
-  [[nodiscard]] size_t Capacity() const { return capacity_; }
+  // Up to max_results pairs with keys in [lo, hi], in key order. Scans the
+  // same sub-structures as Read, each for max_results pairs, and merges them.
+  std::vector<KeyValPair> RangeScan(Key lo, Key hi, size_t max_results,
+                                    crypto::Key enc_key);
+  // Looks like an operation of kind `op`, without touching the map.
+  void Dummy(Op op, crypto::Key enc_key);
+  [[nodiscard]] size_t Capacity() const {
+    auto lock = migrator_.Foreground();
+    return capacity_;
+  }
   [[nodiscard]] size_t Size() const;
-  [[nodiscard]] uint64_t MemoryAccessCount() const { return memory_access_count_; }
-  [[nodiscard]] uint64_t MemoryBytesMovedTotal() const { return memory_bytes_moved_total_; }
+  [[nodiscard]] uint64_t MemoryAccessCount() const {
+    auto lock = migrator_.Foreground();
+    return memory_access_count_;
+  }
+  [[nodiscard]] uint64_t MemoryBytesMovedTotal() const {
+    auto lock = migrator_.Foreground();
+    return memory_bytes_moved_total_;
+  }
   [[nodiscard]] bool IsOnDisk() const;
 
  private:
@@ -46,14 +123,45 @@ class OMap {
   const size_t val_len_;
   size_t size_ = 0;
   const std::string store_path_ = "";
-  std::array<std::unique_ptr<POMap>, 2> sub_omaps_{};
+  store::StorePool store_pool_; // Outlives the sub-structures.
+  std::array<std::unique_ptr<StaticOMap>, 2> sub_omaps_{};
   uint64_t memory_access_count_ = 0;
   uint64_t memory_bytes_moved_total_ = 0;
   const uint8_t max_mem_level_;
+  const Options opts_;
+  const utils::GrowthSteps steps_;
+  utils::ThreadPool pool_; // Runs the per-sub-structure parts of an operation.
+  static Options WithStorePool(Options opts, store::StorePool *store_pool) {
+    opts.store_pool_ = store_pool;
+    return opts;
+  }
+  // The moves of Grow or Shrink: take(0), then take(i) alongside put(i - 1)
+  // for each following one, then put(count - 1).
+  void Move(size_t count, const std::function<void(size_t)> &take,
+            const std::function<void(size_t)> &put);
+  // Between the step s and the next one.
+  [[nodiscard]] size_t MovesPerGrow(size_t s) const {
+    return steps_.MovesToEmpty(s) + 1;
+  }
   [[nodiscard]] size_t TotalSizeOfSubOmaps() const;
+  [[nodiscard]] bool InsertIntoSmaller() const;
   [[nodiscard]] uint64_t SubOMapsMemoryAccessCountSum() const;
   [[nodiscard]] uint64_t SubOMapsMemoryBytesMovedTotalSum() const;
+  const size_t grow_ahead_;
+  crypto::Key migrate_key_{};
+  bool has_migrate_key_ = false;
+  // Last, so that it stops before the sub-structures go.
+  utils::BackgroundMigrator migrator_;
+  void StartMigrator();
+  // Locks out the migrator for the operation, and records its key.
+  utils::BackgroundMigrator::Lock Foreground(const crypto::Key &enc_key);
 };
+
+using OMap = BasicOMap<static_path_omap::OMap>;
+using BPlusOMap = BasicOMap<static_path_bplus_omap::OMap>;
+// E.g. KeyedOMap<bytes::FixedBytes<16>> for UUID keys.
+template<typename K>
+using KeyedOMap = BasicOMap<static_path_omap::BasicOMap<K>>;
 } // dyno::dynamic_stepping_path_omap
 
 #endif //DYNO_DYNAMIC_OMAP_STEPPING_PATH_OMAP_H_
@@ -6,64 +6,197 @@
 #include <cstdint>
 #include <memory>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "../../../utils/crypto.h"
 
 namespace dyno::dynamic_stepping_path_oram {
 
-ORam::ORam(int starting_size_power_of_two, size_t val_len)
+ORam::ORam(int starting_size_power_of_two, size_t val_len, std::string path,
+           uint8_t max_levels_in_mem, Options opts)
     : capacity_(1UL << starting_size_power_of_two),
       val_len_(val_len),
-      size_(1UL << (starting_size_power_of_two)) {
-  auto base_cap = capacity_ >> 1;
-  for (int i = 0; i < 2; ++i)
-    sub_orams_[i] = std::make_unique<PORam>(base_cap << i, val_len, true);
-}
-
-bool IsPowerOfTwo(size_t x) {
-  return !(x & (x - 1));
+      size_(1UL << (starting_size_power_of_two)),
+      steps_(opts.growth_factor_),
+      store_pool_(std::move(path), max_levels_in_mem),
+      pool_(opts.num_threads_),
+      grow_ahead_(opts.grow_ahead_) {
+  if (steps_.IsStep(capacity_)) {
+    sub_orams_[1] = NewSubORam(capacity_);
+  } else {
+    sub_orams_[0] = NewSubORam(steps_.Below(capacity_));
+    sub_orams_[1] = NewSubORam(steps_.Above(sub_orams_[0]->Capacity()));
+  }
+  StartMigrator();
 }
 
 void ORam::Grow(crypto::Key enc_key) {
+  auto lock = Foreground(enc_key);
   if (capacity_ == 0) {
-    sub_orams_[1] = std::make_unique<PORam>(1, val_len_, true);
+    sub_orams_[1] = NewSubORam(1);
     ++capacity_;
     return;
   }
 
-  if (IsPowerOfTwo(capacity_)) {
-    assert(sub_orams_[1] != nullptr);
+  if (steps_.IsStep(capacity_)) {
+    assert(sub_orams_[0] == nullptr && sub_orams_[1] != nullptr);
     sub_orams_[0] = std::move(sub_orams_[1]);
-    sub_orams_[1] = std::make_unique<PORam>(2 * capacity_, val_len_, true);
+    sub_orams_[1] = NewSubORam(steps_.Above(capacity_));
   }
 
   assert(sub_orams_[0] != nullptr && sub_orams_[1] != nullptr);
-  Key move_idx = (capacity_ % sub_orams_[0]->Capacity()) + 1;
+  // Keys first, ..., first + moves - 1 move across; those past the smaller
+  // sub-ORAM's capacity are dummy moves.
+  size_t s = sub_orams_[0]->Capacity();
+  size_t moves = steps_.MovesToEmpty(s);
+  Key first = (capacity_ - s) * moves + 1;
   auto start_accesses = SubORamsMemoryAccessCountSum();
   auto start_bytes = SubORamsMemoryBytesMovedTotalSum();
-  auto move_bl = sub_orams_[0]->ReadAndRemove(0, move_idx, enc_key);
-  if (!move_bl.meta_.key_) {
-    sub_orams_[1]->DummyAccess(enc_key);
-  } else {
-    sub_orams_[1]->Insert(std::move(move_bl), enc_key);
-  }
+  std::vector<PORamBlock> moved;
+  for (size_t i = 0; i < moves; ++i)
+    moved.emplace_back(true);
+  Move(moves,
+       [&](size_t i) {
+         if (first + i <= s)
+           moved[i] = sub_orams_[0]->ReadAndRemove(0, first + i, enc_key);
+         else
+           sub_orams_[0]->DummyAccess(enc_key);
+       },
+       [&](size_t i) {
+         if (!moved[i].meta_.key_) {
+           sub_orams_[1]->DummyAccess(enc_key);
+         } else {
+           sub_orams_[1]->Insert(std::move(moved[i]), enc_key);
+         }
+       });
   memory_access_count_ += SubORamsMemoryAccessCountSum() - start_accesses;
   memory_bytes_moved_total_ += SubORamsMemoryBytesMovedTotalSum() - start_bytes;
   ++capacity_;
+
+  if (steps_.IsStep(capacity_)) // The smaller one is now empty.
+    sub_orams_[0].reset();
+}
+
+void ORam::Shrink(crypto::Key enc_key) {
+  auto lock = Foreground(enc_key);
+  if (capacity_ == 0)
+    return;
+
+  if (capacity_ == 1) {
+    sub_orams_[1].reset();
+    capacity_ = 0;
+    size_ = 0;
+    return;
+  }
+
+  if (steps_.IsStep(capacity_)) {
+    assert(sub_orams_[0] == nullptr && sub_orams_[1] != nullptr);
+    sub_orams_[0] = NewSubORam(steps_.Below(capacity_));
+  }
+
+  assert(sub_orams_[0] != nullptr && sub_orams_[1] != nullptr);
+  auto start_accesses = SubORamsMemoryAccessCountSum();
+  auto start_bytes = SubORamsMemoryBytesMovedTotalSum();
+  // The keys the matching Grow moved out of the smaller sub-ORAM move back,
+  // then the last key, which is in the larger one, leaves.
+  size_t s = sub_orams_[0]->Capacity();
+  size_t moves = steps_.MovesToEmpty(s);
+  Key first = (capacity_ - 1 - s) * moves + 1;
+  std::vector<PORamBlock> moved;
+  for (size_t i = 0; i < moves; ++i)
+    moved.emplace_back(true);
+  Move(moves + 1,
+       [&](size_t i) {
+         if (i == moves) {
+           if (sub_orams_[1]->ReadAndRemove(0, capacity_, enc_key).meta_.key_)
+             --size_;
+         } else if (first + i <= s) {
+           moved[i] = sub_orams_[1]->ReadAndRemove(0, first + i, enc_key);
+         } else {
+           sub_orams_[1]->DummyAccess(enc_key);
+         }
+       },
+       [&](size_t i) {
+         if (i == moves)
+           return;
+         if (!moved[i].meta_.key_) {
+           sub_orams_[0]->DummyAccess(enc_key);
+         } else {
+           sub_orams_[0]->Insert(std::move(moved[i]), enc_key);
+         }
+       });
+  memory_access_count_ += SubORamsMemoryAccessCountSum() - start_accesses;
+  memory_bytes_moved_total_ += SubORamsMemoryBytesMovedTotalSum() - start_bytes;
+  --capacity_;
+
+  if (steps_.IsStep(capacity_)) // Everything is in the smaller one.
+    sub_orams_[1] = std::move(sub_orams_[0]);
+}
+
+uint64_t ORam::Resize(size_t n, crypto::Key enc_key) {
+  auto lock = Foreground(enc_key);
+  auto start_bytes = memory_bytes_moved_total_;
+  auto start_accesses = SubORamsMemoryAccessCountSum();
+  auto start_sub_bytes = SubORamsMemoryBytesMovedTotalSum();
+  std::array<std::vector<PORamBlock>, 2> taken;
+  pool_.ParallelFor(2, [&](size_t i) {
+    if (sub_orams_[i] != nullptr)
+      taken[i] = sub_orams_[i]->TakeAll(enc_key);
+  });
+  memory_access_count_ += SubORamsMemoryAccessCountSum() - start_accesses;
+  memory_bytes_moved_total_ +=
+      SubORamsMemoryBytesMovedTotalSum() - start_sub_bytes;
+  std::vector<PORamBlock> blocks;
+  for (auto &t : taken)
+    for (auto &b : t)
+      if (b.meta_.key_ <= n)
+        blocks.push_back(std::move(b));
+  for (auto &so : sub_orams_)
+    so.reset();
+
+  capacity_ = n;
+  size_ = blocks.size();
+  if (n == 0)
+    return memory_bytes_moved_total_ - start_bytes;
+  // As left by Grow: one sub-ORAM at a step, else s and the step after it.
+  if (steps_.IsStep(n)) {
+    sub_orams_[1] = NewSubORam(n);
+  } else {
+    sub_orams_[0] = NewSubORam(steps_.Below(n));
+    sub_orams_[1] = NewSubORam(steps_.Above(sub_orams_[0]->Capacity()));
+  }
+  std::array<std::vector<PORamBlock>, 2> parts;
+  for (auto &b : blocks)
+    parts[SubOramIndex(b.meta_.key_)].push_back(std::move(b));
+  // Even an empty part is loaded, so the cost does not depend on the keys.
+  pool_.ParallelFor(2, [&](size_t i) {
+    if (sub_orams_[i] != nullptr)
+      sub_orams_[i]->BulkLoad(std::move(parts[i]), enc_key);
+  });
+  memory_access_count_ += SubORamsMemoryAccessCountSum();
+  memory_bytes_moved_total_ += SubORamsMemoryBytesMovedTotalSum();
+  return memory_bytes_moved_total_ - start_bytes;
+}
+
+uint64_t ORam::Reserve(size_t n, crypto::Key enc_key) {
+  auto lock = Foreground(enc_key);
+  return n > capacity_ ? Resize(n, enc_key) : 0;
 }
 
 // Returns 0-value of Val if nothing found.
 Block ORam::ReadAndRemove(Key k, crypto::Key enc_key) {
+  auto lock = Foreground(enc_key);
   assert(1 <= k && k <= capacity_);
   Block res;
   auto idx = SubOramIndex(k);
   auto start_accesses = SubORamsMemoryAccessCountSum();
   auto start_bytes = SubORamsMemoryBytesMovedTotalSum();
-  for (int i = 0; i < 2; ++i) {
+  pool_.ParallelFor(2, [&](size_t i) {
     // Skip the first sub structure if 1. it's null (size==1) or it's known to
-    // be empty (IsPowerOfTwo(capacity_)).
-    if (i == 0 && (sub_orams_[i] == nullptr || IsPowerOfTwo(capacity_)))
-      continue;
+    // be empty (steps_.IsStep(capacity_)).
+    if (i == 0 && (sub_orams_[i] == nullptr || steps_.IsStep(capacity_)))
+      return;
 
     if (i == idx) {
       auto bl = sub_orams_[i]->ReadAndRemove(0, k, enc_key);
@@ -71,7 +204,7 @@ Block ORam::ReadAndRemove(Key k, crypto::Key enc_key) {
     } else {
       sub_orams_[i]->DummyAccess(enc_key);
     }
-  }
+  });
   if (res.key_)
     --size_;
   memory_access_count_ += SubORamsMemoryAccessCountSum() - start_accesses;
@@ -81,16 +214,17 @@ Block ORam::ReadAndRemove(Key k, crypto::Key enc_key) {
 
 // Returns 0-value of Val if nothing found.
 Block ORam::Read(Key k, crypto::Key enc_key) {
+  auto lock = Foreground(enc_key);
   assert(1 <= k && k <= capacity_);
   Block res;
   auto idx = SubOramIndex(k);
   auto start_accesses = SubORamsMemoryAccessCountSum();
   auto start_bytes = SubORamsMemoryBytesMovedTotalSum();
-  for (int i = 0; i < 2; ++i) {
+  pool_.ParallelFor(2, [&](size_t i) {
     // Skip the first sub structure if 1. it's null (size==1) or it's known to
-    // be empty (IsPowerOfTwo(capacity_)).
-    if (i == 0 && (sub_orams_[i] == nullptr || IsPowerOfTwo(capacity_)))
-      continue;
+    // be empty (steps_.IsStep(capacity_)).
+    if (i == 0 && (sub_orams_[i] == nullptr || steps_.IsStep(capacity_)))
+      return;
 
     if (i == idx) {
       auto bl = sub_orams_[i]->Read(0, k, enc_key);
@@ -98,42 +232,102 @@ Block ORam::Read(Key k, crypto::Key enc_key) {
     } else {
       sub_orams_[i]->DummyAccess(enc_key);
     }
-  }
+  });
   memory_access_count_ += SubORamsMemoryAccessCountSum() - start_accesses;
   memory_bytes_moved_total_ += SubORamsMemoryBytesMovedTotalSum() - start_bytes;
   return res;
 }
 
 void ORam::Insert(Key k, Val v, crypto::Key enc_key) {
+  auto lock = Foreground(enc_key);
   assert(1 <= k && k <= capacity_);
   auto idx = SubOramIndex(k);
   auto start_accesses = SubORamsMemoryAccessCountSum();
   auto start_bytes = SubORamsMemoryBytesMovedTotalSum();
-  for (int i = 0; i < 2; ++i) {
-    if (sub_orams_[i] == nullptr)
-      continue;
+  pool_.ParallelFor(2, [&](size_t i) {
+    // Same skipping as in Read: the first sub structure is never the target
+    // when steps_.IsStep(capacity_).
+    if (i == 0 && (sub_orams_[i] == nullptr || steps_.IsStep(capacity_)))
+      return;
 
     if (i == idx) {
       sub_orams_[i]->Insert({0, k, std::move(v)}, enc_key);
     } else {
       sub_orams_[i]->DummyAccess(enc_key);
     }
-  }
+  });
   ++size_;
   memory_access_count_ += SubORamsMemoryAccessCountSum() - start_accesses;
   memory_bytes_moved_total_ += SubORamsMemoryBytesMovedTotalSum() - start_bytes;
 }
 
+void ORam::DummyAccess(crypto::Key enc_key) {
+  auto lock = Foreground(enc_key);
+  assert(capacity_ > 0);
+  auto start_accesses = SubORamsMemoryAccessCountSum();
+  auto start_bytes = SubORamsMemoryBytesMovedTotalSum();
+  pool_.ParallelFor(2, [&](size_t i) {
+    if (i == 0 && (sub_orams_[i] == nullptr || steps_.IsStep(capacity_)))
+      return;
+    sub_orams_[i]->DummyAccess(enc_key);
+  });
+  memory_access_count_ += SubORamsMemoryAccessCountSum() - start_accesses;
+  memory_bytes_moved_total_ += SubORamsMemoryBytesMovedTotalSum() - start_bytes;
+}
+
+void ORam::Move(size_t count, const std::function<void(size_t)> &take,
+                const std::function<void(size_t)> &put) {
+  take(0);
+  for (size_t j = 1; j < count; ++j)
+    pool_.ParallelFor(2, [&](size_t i) {
+      if (i)
+        put(j - 1);
+      else
+        take(j);
+    });
+  put(count - 1);
+}
+
+void ORam::StartMigrator() {
+  if (!grow_ahead_)
+    return;
+  migrator_.Start(
+      [this] { return has_migrate_key_ && capacity_ < size_ + grow_ahead_; },
+      [this] { Grow(migrate_key_); });
+}
+
+utils::BackgroundMigrator::Lock ORam::Foreground(const crypto::Key &enc_key) {
+  auto lock = migrator_.Foreground();
+  migrate_key_ = enc_key;
+  has_migrate_key_ = true;
+  return lock;
+}
+
+std::unique_ptr<PORam> ORam::NewSubORam(size_t n) {
+  static_path_oram::Options opts;
+  opts.store_pool_ = &store_pool_;
+  return std::make_unique<PORam>(n, val_len_, true, false, opts);
+}
+
 uint8_t ORam::SubOramIndex(Key k) {
   assert(1 <= k && k <= capacity_);
-  if (capacity_ == 1)
+  if (sub_orams_[0] == nullptr) // At a step.
     return 1;
-  if (k > sub_orams_[0]->Capacity() ||
-      k <= (capacity_ - sub_orams_[0]->Capacity()))
+  size_t s = sub_orams_[0]->Capacity();
+  if (k > s || k <= (capacity_ - s) * steps_.MovesToEmpty(s))
     return 1;
   return 0;
 }
 
+bool ORam::IsOnDisk() const {
+  auto lock = migrator_.Foreground();
+  bool res = false;
+  for (auto &so : sub_orams_)
+    if (so != nullptr)
+      res |= so->IsOnDisk();
+  return res;
+}
+
 uint64_t ORam::SubORamsMemoryAccessCountSum() {
   uint64_t res = 0;
   for (auto &so : sub_orams_) {
@@ -4,10 +4,18 @@
 #include <array>
 #include <cstddef>
 #include <cstdint>
+#include <functional>
 #include <memory>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "../../../static/oram/path/oram.h"
+#include "../../../store/store_pool.h"
+#include "../../../utils/background_migrator.h"
 #include "../../../utils/crypto.h"
+#include "../../../utils/growth_steps.h"
+#include "../../../utils/thread_pool.h"
 
 namespace dyno::dynamic_stepping_path_oram {
 
@@ -26,31 +34,119 @@ class Block {
   explicit Block(PORamBlock b) : key_(b.meta_.key_), val_(std::move(b.val_)) {}
 };
 
+class Options {
+ public:
+  // Threads for the accesses an operation makes to each sub-ORAM; with 2 they
+  // run at the same time.
+  unsigned num_threads_ = 1;
+  // Capacity ratio of the larger sub-ORAM to the smaller, see
+  // utils::GrowthSteps; with less than 2, Grow and Shrink move several keys.
+  double growth_factor_ = 2;
+  // With h > 0, a background thread runs Grow while Capacity() < Size() + h,
+  // see utils::BackgroundMigrator, so a burst of up to h new keys finds the
+  // capacity ready. It uses the key of the latest operation.
+  size_t grow_ahead_ = 0;
+};
+
 // Assumes 1-based positions ([1, N]).
+//
+// Between steps s and t (powers of two by default, see
+// Options::growth_factor_), capacity c in (s, t] is split over a sub-ORAM of
+// capacity s and one of t: with m = GrowthSteps::MovesToEmpty(s), keys
+// (min(s, (c - s) * m), s] live in the first, the rest in the second. Each Grow
+// or Shrink moves m keys across (some may be dummy moves), so at a step the
+// smaller sub-ORAM is empty, and its store is released. Which keys move only
+// depends on the capacity.
+//
+// Sub-ORAM stores come from a store::StorePool, so the one released at a step
+// is resized for the next one instead of allocating anew. As in the dynamic
+// OMap, they are in RAM, or with a path, each has the top max_levels_in_mem
+// levels in RAM and the rest in its own file (path.0, path.1, ...).
+//
+// The two sub-ORAMs share nothing, so with Options::num_threads_ = 2 an
+// operation takes about as long as the slower of its accesses to them.
+//
+// With Options::grow_ahead_, Grow steps also run between operations on a
+// background thread. Each step makes the same accesses as an explicit Grow,
+// and when one runs depends on Size() as when the caller grows on demand.
+// Shrink stays with the caller, as it drops a key.
 class ORam {
  public:
-  explicit ORam(size_t val_len) : val_len_(val_len) {}
-  // Only implemented for benchmarks.
-  ORam(int starting_size_power_of_two, size_t val_len);
+  explicit ORam(size_t val_len, Options opts = Options())
+      : ORam(val_len, "", 0, opts) {}
+  // PosixSingleFile -- On file store error reverts to RAM store.
+  ORam(size_t val_len, std::string path, uint8_t max_levels_in_mem,
+       Options opts = Options())
+      : val_len_(val_len),
+        steps_(opts.growth_factor_),
+        store_pool_(std::move(path), max_levels_in_mem),
+        pool_(opts.num_threads_),
+        grow_ahead_(opts.grow_ahead_) {
+    StartMigrator();
+  }
+  // Only implemented for benchmarks --- PosixSingleFile.
+  ORam(int starting_size_power_of_two, size_t val_len, std::string path = "",
+       uint8_t max_levels_in_mem = 0, Options opts = Options());
   void Grow(crypto::Key enc_key);
+  // Undoes a Grow. The block at key Capacity(), if any, is dropped.
+  void Shrink(crypto::Key enc_key);
+  // Goes straight to the layout of capacity n, instead of |n - Capacity()|
+  // Grow or Shrink steps: every sub-ORAM is read out once (PORam::TakeAll),
+  // blocks at keys above n are dropped, and the new sub-ORAMs are bulk loaded.
+  // The cost only depends on the old and new capacities. Returns the bytes
+  // moved, which are also added to MemoryBytesMovedTotal().
+  uint64_t Resize(size_t n, crypto::Key enc_key);
+  // Resize(n) if n > Capacity(); else a no-op that returns 0.
+  uint64_t Reserve(size_t n, crypto::Key enc_key);
   Block ReadAndRemove(Key k, crypto::Key enc_key);
   Block Read(Key k, crypto::Key enc_key);
   void Insert(Key k, Val v, crypto::Key enc_key);
-  [[nodiscard]] size_t Capacity() const { return capacity_; }
-  [[nodiscard]] size_t Size() const { return size_; }
-  [[nodiscard]] uint64_t MemoryAccessCount() const { return memory_access_count_; }
-  [[nodiscard]] uint64_t MemoryBytesMovedTotal() const { return memory_bytes_moved_total_; }
+  // Looks like any of the above, without touching the ORAM.
+  void DummyAccess(crypto::Key enc_key);
+  [[nodiscard]] size_t Capacity() const {
+    auto lock = migrator_.Foreground();
+    return capacity_;
+  }
+  [[nodiscard]] size_t Size() const {
+    auto lock = migrator_.Foreground();
+    return size_;
+  }
+  [[nodiscard]] uint64_t MemoryAccessCount() const {
+    auto lock = migrator_.Foreground();
+    return memory_access_count_;
+  }
+  [[nodiscard]] uint64_t MemoryBytesMovedTotal() const {
+    auto lock = migrator_.Foreground();
+    return memory_bytes_moved_total_;
+  }
+  [[nodiscard]] bool IsOnDisk() const;
 
  private:
   size_t capacity_ = 0;
   const size_t val_len_;
   size_t size_ = 0;
+  const utils::GrowthSteps steps_;
+  store::StorePool store_pool_; // Outlives the sub-ORAMs.
   std::array<std::unique_ptr<PORam>, 2> sub_orams_{};
+  utils::ThreadPool pool_; // Runs the per-sub-ORAM parts of an operation.
+  std::unique_ptr<PORam> NewSubORam(size_t n);
+  // The moves of Grow or Shrink: take(0), then take(i) alongside put(i - 1)
+  // for each following one, then put(count - 1).
+  void Move(size_t count, const std::function<void(size_t)> &take,
+            const std::function<void(size_t)> &put);
   uint8_t SubOramIndex(Key k);
   uint64_t memory_access_count_ = 0;
   uint64_t memory_bytes_moved_total_ = 0;
   uint64_t SubORamsMemoryAccessCountSum();
   uint64_t SubORamsMemoryBytesMovedTotalSum();
+  const size_t grow_ahead_;
+  crypto::Key migrate_key_{};
+  bool has_migrate_key_ = false;
+  // Last, so that it stops before the sub-ORAMs go.
+  utils::BackgroundMigrator migrator_;
+  void StartMigrator();
+  // Locks out the migrator for the operation, and records its key.
+  utils::BackgroundMigrator::Lock Foreground(const crypto::Key &enc_key);
 };
 } // dyno::dynamic_stepping_path_oram
 
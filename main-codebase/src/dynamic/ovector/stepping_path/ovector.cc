@@ -0,0 +1,38 @@
+#include "ovector.h"
+
+#include <cassert>
+#include <cstddef>
+#include <utility>
+
+#include "../../../utils/crypto.h"
+
+namespace dyno::dynamic_stepping_path_ovector {
+
+using dynamic_stepping_path_oram::Key;
+
+void OVector::PushBack(Val v, crypto::Key enc_key) {
+  if (oram_.Size() == oram_.Capacity())
+    oram_.Grow(enc_key);
+  oram_.Insert(Key(oram_.Size() + 1), std::move(v), enc_key);
+}
+
+Val OVector::PopBack(crypto::Key enc_key) {
+  assert(oram_.Size() > 0);
+  auto res = std::move(oram_.ReadAndRemove(Key(oram_.Size()), enc_key).val_);
+  if (oram_.Capacity() > oram_.Size())
+    oram_.Shrink(enc_key);
+  return res;
+}
+
+Val OVector::Get(size_t i, crypto::Key enc_key) {
+  assert(i < oram_.Size());
+  return std::move(oram_.Read(Key(i + 1), enc_key).val_);
+}
+
+void OVector::Set(size_t i, Val v, crypto::Key enc_key) {
+  assert(i < oram_.Size());
+  // A second copy of the key would shadow the old one, but not remove it.
+  oram_.ReadAndRemove(Key(i + 1), enc_key);
+  oram_.Insert(Key(i + 1), std::move(v), enc_key);
+}
+} // namespace dyno::dynamic_stepping_path_ovector
@@ -0,0 +1,42 @@
+#ifndef DYNO_DYNAMIC_OVECTOR_STEPPING_PATH_OVECTOR_H_
+#define DYNO_DYNAMIC_OVECTOR_STEPPING_PATH_OVECTOR_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "../../oram/stepping_path/oram.h"
+#include "../../../utils/crypto.h"
+
+namespace dyno::dynamic_stepping_path_ovector {
+
+using Val = dynamic_stepping_path_oram::Val;
+
+// An array of fixed-size values, stored at keys 1..Size() of a dynamic ORAM,
+// so an access costs O(log n) instead of the O(log^2 n) of the dynamic OMap.
+// The index of an access is hidden; Size() is not, as every PushBack and
+// PopBack is visible, and so is every Grow.
+class OVector {
+ public:
+  explicit OVector(size_t val_len) : oram_(val_len) {}
+  // Only implemented for benchmarks.
+  OVector(int starting_size_power_of_two, size_t val_len)
+      : oram_(starting_size_power_of_two, val_len) {}
+  // Grows the ORAM first when it is full.
+  void PushBack(Val v, crypto::Key enc_key);
+  // Removes and returns the last value, and shrinks the ORAM by its slot.
+  Val PopBack(crypto::Key enc_key);
+  // 0-based, i < Size().
+  Val Get(size_t i, crypto::Key enc_key);
+  // Two ORAM accesses: the old value is removed before the new one goes in.
+  void Set(size_t i, Val v, crypto::Key enc_key);
+  [[nodiscard]] size_t Size() const { return oram_.Size(); }
+  [[nodiscard]] size_t Capacity() const { return oram_.Capacity(); }
+  [[nodiscard]] uint64_t MemoryAccessCount() const { return oram_.MemoryAccessCount(); }
+  [[nodiscard]] uint64_t MemoryBytesMovedTotal() const { return oram_.MemoryBytesMovedTotal(); }
+
+ private:
+  dynamic_stepping_path_oram::ORam oram_;
+};
+} // namespace dyno::dynamic_stepping_path_ovector
+
+#endif //DYNO_DYNAMIC_OVECTOR_STEPPING_PATH_OVECTOR_H_
@@ -0,0 +1,98 @@
+#include "omap.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../../../dynamic/omap/stepping_path/omap.h"
+#include "../../../utils/crypto.h"
+#include "../../../utils/shard_set.h"
+
+namespace dyno::sharded_stepping_path_omap {
+
+OMap::OMap(size_t val_len, unsigned num_shards, const std::string &file_path,
+           uint8_t max_levels_in_mem, size_t batch_slack)
+    : val_len_(val_len),
+      batch_slack_(batch_slack),
+      shards_(num_shards, [&](unsigned int i) {
+        return std::make_unique<DOMap>(
+            val_len, utils::ShardSet<DOMap>::ShardPath(file_path, i),
+            max_levels_in_mem);
+      }) {}
+
+void OMap::Grow(crypto::Key enc_key) {
+  shards_.OnAll([&](unsigned int i) { shards_[i].Grow(enc_key); });
+}
+
+void OMap::Insert(Key k, Val v, crypto::Key enc_key) {
+  auto s = shards_.ShardOf(k);
+  if (shards_[s].Size() == shards_[s].Capacity())
+    Grow(enc_key);
+  shards_.OnAll([&](unsigned int i) {
+    if (i == s)
+      shards_[i].Insert(k, std::move(v), enc_key);
+    else
+      shards_[i].Dummy(Op::kInsert, enc_key);
+  });
+}
+
+Val OMap::Read(Key k, crypto::Key enc_key) {
+  if (!Capacity())
+    return nullptr;
+  auto s = shards_.ShardOf(k);
+  Val res;
+  shards_.OnAll([&](unsigned int i) {
+    auto v = shards_[i].Read(i == s ? k : 0, enc_key);
+    if (i == s)
+      res = std::move(v);
+  });
+  return res;
+}
+
+Val OMap::ReadAndRemove(Key k, crypto::Key enc_key) {
+  if (!Capacity())
+    return nullptr;
+  auto s = shards_.ShardOf(k);
+  Val res;
+  shards_.OnAll([&](unsigned int i) {
+    if (i == s)
+      res = shards_[i].ReadAndRemove(k, enc_key);
+    else
+      shards_[i].Dummy(Op::kDelete, enc_key);
+  });
+  return res;
+}
+
+std::vector<Val> OMap::ReadBatch(const std::vector<Key> &keys,
+                                 crypto::Key enc_key) {
+  std::vector<Val> res(keys.size());
+  if (!Capacity())
+    return res;
+
+  const auto num_shards = shards_.NumShards();
+  const size_t per_round =
+      ((keys.size() + num_shards - 1) / num_shards) + batch_slack_;
+  std::vector<std::vector<unsigned int>> shard_idx(num_shards);
+  for (unsigned int i = 0; i < keys.size(); ++i)
+    shard_idx[shards_.ShardOf(keys[i])].push_back(i);
+  size_t rounds = 1;
+  for (auto &si : shard_idx)
+    rounds = std::max(rounds, (si.size() + per_round - 1) / per_round);
+
+  shards_.OnAll([&](unsigned int s) {
+    auto &si = shard_idx[s];
+    for (size_t j = 0; j < rounds * per_round; ++j) {
+      if (j < si.size())
+        res[si[j]] = shards_[s].Read(keys[si[j]], enc_key);
+      else
+        shards_[s].Dummy(Op::kRead, enc_key);
+    }
+  });
+  return res;
+}
+
+} // namespace dyno::sharded_stepping_path_omap
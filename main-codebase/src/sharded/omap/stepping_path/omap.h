@@ -0,0 +1,53 @@
+#ifndef DYNO_SHARDED_OMAP_STEPPING_PATH_OMAP_H_
+#define DYNO_SHARDED_OMAP_STEPPING_PATH_OMAP_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "../../../dynamic/omap/stepping_path/omap.h"
+#include "../../../utils/crypto.h"
+#include "../../../utils/shard_set.h"
+
+namespace dyno::sharded_stepping_path_omap {
+
+using DOMap = dynamic_stepping_path_omap::OMap;
+using Key = dynamic_stepping_path_omap::Key;
+using Val = dynamic_stepping_path_omap::Val;
+using Op = dynamic_stepping_path_omap::Op;
+
+// Splits the key space over `num_shards` dynamic OMaps using a keyed PRF;
+// see sharded_path_oram::ORam for the threading and padding scheme. All
+// shards always have the same capacity: Grow grows every shard by one, and
+// Insert grows all shards first when the key's shard is full (which reveals
+// that some shard reached its capacity).
+class OMap {
+ public:
+  // PosixSingleFile -- shard i uses `file_path`.i; on file store error reverts
+  // to RAM store.
+  OMap(size_t val_len, unsigned num_shards, const std::string &file_path = "",
+       uint8_t max_levels_in_mem = 0, size_t batch_slack = 2);
+  void Grow(crypto::Key enc_key);
+  void Insert(Key k, Val v, crypto::Key enc_key);
+  Val Read(Key k, crypto::Key enc_key);
+  Val ReadAndRemove(Key k, crypto::Key enc_key);
+  // Batched, padded reads; see sharded_path_oram::ORam::ReadBatch.
+  std::vector<Val> ReadBatch(const std::vector<Key> &keys,
+                             crypto::Key enc_key);
+  [[nodiscard]] unsigned NumShards() const { return shards_.NumShards(); }
+  [[nodiscard]] size_t Capacity() const { return shards_.Capacity(); }
+  [[nodiscard]] size_t Size() const { return shards_.Size(); }
+  [[nodiscard]] uint64_t MemoryAccessCount() const { return shards_.MemoryAccessCount(); }
+  [[nodiscard]] uint64_t MemoryBytesMovedTotal() const { return shards_.MemoryBytesMovedTotal(); }
+  [[nodiscard]] bool IsOnDisk() const { return shards_.IsOnDisk(); }
+
+ private:
+  const size_t val_len_;
+  const size_t batch_slack_;
+  utils::ShardSet<DOMap> shards_;
+};
+
+} // namespace dyno::sharded_stepping_path_omap
+
+#endif //DYNO_SHARDED_OMAP_STEPPING_PATH_OMAP_H_
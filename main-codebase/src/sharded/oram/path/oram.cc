@@ -0,0 +1,133 @@
+#include "oram.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../../../static/oram/path/oram.h"
+#include "../../../utils/crypto.h"
+#include "../../../utils/shard_set.h"
+
+namespace dyno::sharded_path_oram {
+
+namespace {
+// The mean load ceil(n / num_shards), plus 4 standard deviations of the
+// PRF's (about Poisson) skew.
+size_t ShardCapacity(size_t n, unsigned num_shards) {
+  size_t mean = (n + num_shards - 1) / num_shards;
+  return mean + static_cast<size_t>(std::ceil(4 * std::sqrt(mean)));
+}
+} // namespace
+
+ORam::ORam(size_t n, size_t val_len, unsigned num_shards,
+           const std::string &file_path, uint8_t max_levels_in_mem,
+           size_t batch_slack)
+    : val_len_(val_len),
+      batch_slack_(batch_slack),
+      shards_(num_shards, [&](unsigned int i) {
+        return std::make_unique<PORam>(
+            ShardCapacity(n, num_shards), val_len,
+            utils::ShardSet<PORam>::ShardPath(file_path, i),
+            max_levels_in_mem, true);
+      }) {}
+
+Block ORam::Read(Key k, crypto::Key enc_key) {
+  auto s = shards_.ShardOf(k);
+  Block res(true);
+  shards_.OnAll([&](unsigned int i) {
+    if (i == s)
+      res = shards_[i].Read(0, k, enc_key);
+    else
+      shards_[i].DummyAccess(enc_key);
+  });
+  res.meta_.pos_ = 0;
+  return res;
+}
+
+Block ORam::ReadAndRemove(Key k, crypto::Key enc_key) {
+  auto s = shards_.ShardOf(k);
+  Block res(true);
+  shards_.OnAll([&](unsigned int i) {
+    if (i == s)
+      res = shards_[i].ReadAndRemove(0, k, enc_key);
+    else
+      shards_[i].DummyAccess(enc_key);
+  });
+  res.meta_.pos_ = 0;
+  return res;
+}
+
+bool ORam::Insert(Key k, Val v, crypto::Key enc_key) {
+  auto s = shards_.ShardOf(k);
+  bool fits = shards_[s].Size() < shards_[s].Capacity();
+  shards_.OnAll([&](unsigned int i) {
+    if (i == s && fits)
+      shards_[i].Insert({0, k, std::move(v)}, enc_key);
+    else
+      shards_[i].DummyAccess(enc_key);
+  });
+  return fits;
+}
+
+std::vector<Block> ORam::ReadBatch(const std::vector<Key> &keys,
+                                   crypto::Key enc_key) {
+  const auto num_shards = shards_.NumShards();
+  const size_t per_round =
+      ((keys.size() + num_shards - 1) / num_shards) + batch_slack_;
+
+  // Distinct keys per shard, and where each key's result goes.
+  std::vector<std::vector<Key>> shard_keys(num_shards);
+  std::map<Key, std::vector<unsigned int>> res_idx;
+  for (unsigned int i = 0; i < keys.size(); ++i) {
+    auto &idx = res_idx[keys[i]];
+    if (idx.empty())
+      shard_keys[shards_.ShardOf(keys[i])].push_back(keys[i]);
+    idx.push_back(i);
+  }
+
+  size_t rounds = 1;
+  for (auto &sk : shard_keys)
+    rounds = std::max(rounds, (sk.size() + per_round - 1) / per_round);
+
+  std::vector<Block> res(keys.size());
+  for (size_t r = 0; r < rounds; ++r) {
+    const size_t done = r * per_round;
+    std::vector<std::vector<Block>> found(num_shards);
+    shards_.OnAll([&](unsigned int i) {
+      auto &sk = shard_keys[i];
+      auto first = sk.begin() + std::min(done, sk.size());
+      auto last = sk.begin() + std::min(done + per_round, sk.size());
+      std::vector<Key> round_keys(first, last);
+      shards_[i].UpdateBatch(
+          round_keys, per_round,
+          [&](std::vector<Block> fetched) {
+            std::vector<Block> write_back;
+            for (auto &b : fetched) {
+              found[i].emplace_back(b, val_len_);
+              if (b.meta_.key_)
+                write_back.push_back(std::move(b));
+            }
+            return write_back;
+          },
+          enc_key);
+    });
+
+    for (unsigned int s = 0; s < num_shards; ++s) {
+      for (unsigned int j = 0; j < found[s].size(); ++j) {
+        auto &b = found[s][j];
+        b.meta_.pos_ = 0;
+        for (auto i : res_idx[shard_keys[s][done + j]])
+          res[i] = Block(b, val_len_);
+      }
+    }
+  }
+  return res;
+}
+
+} // namespace dyno::sharded_path_oram
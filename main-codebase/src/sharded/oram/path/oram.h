@@ -0,0 +1,61 @@
+#ifndef DYNO_SHARDED_ORAM_PATH_ORAM_H_
+#define DYNO_SHARDED_ORAM_PATH_ORAM_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "../../../static/oram/path/oram.h"
+#include "../../../utils/crypto.h"
+#include "../../../utils/shard_set.h"
+
+namespace dyno::sharded_path_oram {
+
+using PORam = static_path_oram::ORam;
+using Block = static_path_oram::Block;
+using Key = static_path_oram::Key;
+using Val = static_path_oram::Val;
+
+// Splits the key space over `num_shards` independent PathORAMs (with position
+// maps) using a keyed PRF. Each shard is owned by a worker thread pinned to
+// its own core, and is only reached through that worker's lock-free queue.
+// Every operation accesses every shard, the real access on the key's shard
+// and a dummy one everywhere else, so the shard of a key is never revealed.
+// As with the dynamic ORAM, Insert expects the key to be absent. Blocks
+// returned have no position.
+class ORam {
+ public:
+  // PosixSingleFile -- shard i uses `file_path`.i; on file store error reverts
+  // to RAM store.
+  ORam(size_t n, size_t val_len, unsigned num_shards,
+       const std::string &file_path = "", uint8_t max_levels_in_mem = 0,
+       size_t batch_slack = 2);
+  Block Read(Key k, crypto::Key enc_key);
+  Block ReadAndRemove(Key k, crypto::Key enc_key);
+  // Returns false, with only dummy accesses made, if the key's shard is full.
+  // Shards have room for n / num_shards keys plus 4 standard deviations of
+  // the PRF's skew, so with up to n keys that should not happen.
+  bool Insert(Key k, Val v, crypto::Key enc_key);
+  // Batched, padded reads. The batch is served in rounds; in each round
+  // every shard serves exactly ceil(|keys| / num_shards) + batch_slack
+  // accesses. The number of rounds (usually one) depends on how unevenly the
+  // keys fall on the shards, and is the only thing the batch reveals.
+  std::vector<Block> ReadBatch(const std::vector<Key> &keys,
+                               crypto::Key enc_key);
+  [[nodiscard]] unsigned NumShards() const { return shards_.NumShards(); }
+  [[nodiscard]] size_t Capacity() const { return shards_.Capacity(); }
+  [[nodiscard]] size_t Size() const { return shards_.Size(); }
+  [[nodiscard]] uint64_t MemoryAccessCount() const { return shards_.MemoryAccessCount(); }
+  [[nodiscard]] uint64_t MemoryBytesMovedTotal() const { return shards_.MemoryBytesMovedTotal(); }
+  [[nodiscard]] bool IsOnDisk() const { return shards_.IsOnDisk(); }
+
+ private:
+  const size_t val_len_;
+  const size_t batch_slack_;
+  utils::ShardSet<PORam> shards_;
+};
+
+} // namespace dyno::sharded_path_oram
+
+#endif //DYNO_SHARDED_ORAM_PATH_ORAM_H_
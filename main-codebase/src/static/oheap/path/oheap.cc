@@ -4,7 +4,10 @@
 #include <array>
 #include <cassert>
 #include <cmath>
+#include <iostream>
+#include <iterator>
 #include <memory>
+#include <string>
 #include <utility>
 #include <vector>
 
@@ -12,6 +15,9 @@
 
 #include "../../../utils/bytes.h"
 #include "../../../utils/crypto.h"
+#include "../../../utils/heap_index.h"
+#include "../../../store/hybrid_store.h"
+#include "../../../store/posix_single_file_store.h"
 #include "../../../store/ram_store.h"
 #include "../../../store/store.h"
 
@@ -70,16 +76,70 @@ void Bucket::ToBytes(uint8_t *res, size_t val_len) {
   min_block_.ToBytes(val_len, res + offset);
 }
 
-OHeap::OHeap(size_t n, size_t val_len)
+OHeap::OHeap(size_t n, size_t val_len, store::StorePool *store_pool)
     : capacity_(n),
       val_len_(val_len),
       depth_(ceil(log2(n))),
       num_buckets_((2 * n) - 1),
-      store_(std::make_unique<store::RamStore>(
-          num_buckets_, EncryptedBucketSize(val_len))),
+      store_pool_(store_pool),
       bucket_buffer_(std::make_unique<uint8_t[]>(BucketSize(val_len))),
       enc_bucket_buffer_(std::make_unique<uint8_t[]>(
-          EncryptedBucketSize(val_len))) {}
+          EncryptedBucketSize(val_len))) {
+  if (store_pool_) {
+    store_ = store_pool_->Acquire(num_buckets_, EncryptedBucketSize(val_len_),
+                                  &is_on_disk_);
+  } else {
+    store_ = std::make_unique<store::RamStore>(
+        num_buckets_, EncryptedBucketSize(val_len_));
+  }
+}
+
+OHeap::OHeap(size_t n, size_t val_len, const std::string &file_path,
+             uint8_t max_levels_in_mem)
+    : capacity_(n),
+      val_len_(val_len),
+      depth_(ceil(log2(n))),
+      num_buckets_((2 * n) - 1),
+      store_pool_(nullptr),
+      bucket_buffer_(std::make_unique<uint8_t[]>(BucketSize(val_len))),
+      enc_bucket_buffer_(std::make_unique<uint8_t[]>(
+          EncryptedBucketSize(val_len))) {
+  if (file_path.empty() || max_levels_in_mem >= depth_) {
+    store_ = std::make_unique<store::RamStore>(
+        num_buckets_, EncryptedBucketSize(val_len_));
+    return;
+  }
+
+  size_t mem_buckets = (2UL << max_levels_in_mem) - 1;
+  size_t disk_buckets = num_buckets_ - mem_buckets;
+
+  auto disk_store = store::PosixSingleFileStore::Construct(
+      disk_buckets, EncryptedBucketSize(val_len_), file_path, true);
+  if (!disk_store) {
+    std::cerr << "Failed to create file store." << std::endl;
+    store_ = std::make_unique<store::RamStore>(
+        num_buckets_, EncryptedBucketSize(val_len_));
+    return;
+  }
+
+  is_on_disk_ = true;
+  if (!mem_buckets) {
+    store_ = std::unique_ptr<store::Store>(disk_store.value());
+    return;
+  }
+
+  std::vector<std::unique_ptr<store::Store>> s;
+  s.push_back(std::make_unique<store::RamStore>(
+      mem_buckets, EncryptedBucketSize(val_len_)));
+  s.emplace_back(disk_store.value());
+  store_ = std::unique_ptr<store::Store>(
+      new store::HybridStore(std::move(s), {mem_buckets, num_buckets_}));
+}
+
+OHeap::~OHeap() {
+  if (store_pool_)
+    store_pool_->Release(std::move(store_));
+}
 
 Block OHeap::FindMin(crypto::Key enc_key, bool pad) {
   ++memory_access_count_;
@@ -163,6 +223,86 @@ void OHeap::FillWithDummies(crypto::Key enc_key) {
   }
 }
 
+void OHeap::BulkLoad(std::vector<Block> blocks, crypto::Key enc_key) {
+  ++memory_access_count_;
+  memory_access_bytes_total_ += num_buckets_ * EncryptedBucketSize(val_len_);
+  size_ += blocks.size();
+
+  // Blocks that may still go in each bucket, starting from their leaves.
+  std::vector<std::vector<Block>> waiting(num_buckets_);
+  for (auto &b : blocks) {
+    b.meta_.pos_ = GeneratePos();
+    waiting[capacity_ - 2 + b.meta_.pos_].push_back(std::move(b));
+  }
+
+  // Children have larger indexes than their parents, so their subtree minimums
+  // are known when the parent is written.
+  std::vector<Block> mins(num_buckets_);
+  for (size_t i = num_buckets_; i-- > 0;) {
+    Bucket bu;
+    auto &here = waiting[i];
+    unsigned int j = 0;
+    for (; j < here.size() && j < kBucketSize; ++j) {
+      bu.blocks_[j] = std::move(here[j]);
+      bu.meta_.flags_ |= kBlockValid[j];
+    }
+    auto &rest = i ? waiting[(i - 1) / 2] : stash_;
+    std::move(here.begin() + j, here.end(), std::back_inserter(rest));
+    here = std::vector<Block>();
+
+    const Block *min = nullptr;
+    for (unsigned int k = 0; k < j; ++k)
+      if (!min || bu.blocks_[k].meta_.key_ < min->meta_.key_)
+        min = &bu.blocks_[k];
+    for (size_t c = (2 * i) + 1; c <= (2 * i) + 2 && c < num_buckets_; ++c) {
+      bu.meta_.flags_ |= c % 2 ? kLeftChildValid : kRightChildValid;
+      if (mins[c].meta_.pos_ && (!min || mins[c].meta_.key_ < min->meta_.key_))
+        min = &mins[c];
+    }
+    mins[i] = min ? Block(*min, val_len_) : Block(true);
+    bu.min_block_ = Block(mins[i], val_len_);
+
+    bu.ToBytes(bucket_buffer_.get(), val_len_);
+    bool ok = crypto::Encrypt(bucket_buffer_.get(), BucketSize(val_len_),
+                              enc_key, enc_bucket_buffer_.get());
+    assert(ok);
+    store_->Write(i, enc_bucket_buffer_.get());
+  }
+  bucket_valid_.clear();
+  bucket_valid_[0] = true;
+}
+
+std::vector<Block> OHeap::TakeAll(crypto::Key enc_key) {
+  ++memory_access_count_;
+  std::vector<Block> res = std::move(stash_);
+  stash_.clear();
+  std::vector<bool> valid(num_buckets_);
+  valid[0] = bucket_valid_[0];
+  // Parents come first, and tell whether their children were written.
+  for (size_t i = 0; i < num_buckets_; ++i) {
+    if (!valid[i])
+      continue;
+    memory_access_bytes_total_ += EncryptedBucketSize(val_len_);
+    auto eb = store_->Read(i);
+    auto plen = crypto::Decrypt(eb, EncryptedBucketSize(val_len_),
+                                enc_key, bucket_buffer_.get());
+    assert(plen == BucketSize(val_len_));
+    auto bu = Bucket(bucket_buffer_.get(), val_len_);
+    if ((2 * i) + 1 < num_buckets_)
+      valid[(2 * i) + 1] = bu.meta_.flags_ & kLeftChildValid;
+    if ((2 * i) + 2 < num_buckets_)
+      valid[(2 * i) + 2] = bu.meta_.flags_ & kRightChildValid;
+    for (int j = 0; j < kBucketSize; ++j) {
+      if (!(bu.meta_.flags_ & kBlockValid[j]))
+        break;
+      res.push_back(std::move(bu.blocks_[j]));
+    }
+  }
+  bucket_valid_.clear();
+  size_ = 0;
+  return res;
+}
+
 void OHeap::ReadPath(Pos p, crypto::Key enc_key,
                      bool erase_if_found, Key k, Val *v) {
   bool found_res = false; // Duplicates are allowed
@@ -205,7 +345,6 @@ void OHeap::UpdateMinAndEvict(Pos pos, crypto::Key enc_key) {
   ++memory_access_count_;
   memory_access_bytes_total_ += path.size() * EncryptedBucketSize(val_len_);
   std::vector<bool> deleted_from_stash(stash_.size());
-  unsigned int level = depth_;
   Block children_min_block(true);
   for (unsigned int idx : path) {
     Bucket bu;
@@ -213,7 +352,7 @@ void OHeap::UpdateMinAndEvict(Pos pos, crypto::Key enc_key) {
     for (int i = 0; i < stash_.size() && bucket_index < kBucketSize; i++) {
       if (deleted_from_stash[i])
         continue;
-      if (PathAtLevel(stash_[i].meta_.pos_, level) == idx) {
+      if (OnPath(stash_[i].meta_.pos_, idx)) {
         bu.blocks_[bucket_index] = std::move(stash_[i]);
         deleted_from_stash[i] = true;
         bu.meta_.flags_ |= kBlockValid[bucket_index];
@@ -263,7 +402,6 @@ void OHeap::UpdateMinAndEvict(Pos pos, crypto::Key enc_key) {
                               enc_key, enc_bucket_buffer_.get());
     assert(ok);
     store_->Write(idx, enc_bucket_buffer_.get());
-    --level;
     sibling_min_block.val_.reset();
   }
 
@@ -296,31 +434,60 @@ Block OHeap::SiblingMin(unsigned int idx, crypto::Key enc_key) {
 
 std::vector<unsigned int> OHeap::Path(Pos pos) const {
   assert(1 <= pos && pos <= capacity_);
-  std::vector<unsigned int> res(depth_ + 1);
-  unsigned int i = 0;
+  std::vector<unsigned int> res;
+  res.reserve(depth_ + 1);
   unsigned int index = capacity_ - 1 + pos;
   while (index > 0) {
-    res[i++] = index - 1; // index is 1-based but we need 0-based array indexes.
+    // index is 1-based but we need 0-based array indexes.
+    res.push_back(index - 1);
     index /= 2;
   }
   return res;
 }
 
-unsigned int OHeap::PathAtLevel(Pos pos, unsigned int level) const {
-  return ((capacity_ - 1 + pos) / (1UL << (depth_ - level))) - 1;
+// Whether bucket idx is on the path of pos.
+bool OHeap::OnPath(Pos pos, unsigned int idx) const {
+  return utils::IsHeapAncestor(idx + 1, capacity_ - 1 + pos);
+}
+
+Pos OHeap::GeneratePosUnder(unsigned int idx) const {
+  // The leaves, 1-based indexes [capacity_, 2 * capacity_), under idx are a
+  // run on each of the (at most two) levels they share with its subtree.
+  std::vector<std::pair<size_t, size_t>> runs;
+  size_t count = 0;
+  for (size_t lo = idx + 1, hi = idx + 2; lo < 2 * capacity_;
+       lo *= 2, hi *= 2) {
+    size_t first = std::max(lo, capacity_);
+    size_t last = std::min(hi, 2 * capacity_);
+    if (first < last) {
+      runs.emplace_back(first, last);
+      count += last - first;
+    }
+  }
+  assert(count > 0);
+  size_t r;
+  RAND_bytes(reinterpret_cast<unsigned char *>(&r), sizeof(r));
+  r %= count;
+  for (auto [first, last] : runs) {
+    if (r < last - first)
+      return first + r - capacity_ + 1;
+    r -= last - first;
+  }
+  return 1; // Not reached.
 }
 
 std::pair<Pos, Pos> OHeap::GeneratePathPair() const {
-  // 1 .. 2^{k-1}
-  Pos pos1 = 1 + ((GeneratePos() - 1) >> 1);
-  // 2^{k-1}+1 .. 2^k
-  Pos pos2 = 1 + (((GeneratePos() - 1) >> 1) | (capacity_ >> 1));
-  return std::make_pair(pos1, pos2);
+  if (capacity_ == 1)
+    return std::make_pair(1, 1);
+  return std::make_pair(GeneratePosUnder(1), GeneratePosUnder(2));
 }
 
 Pos OHeap::GenerateSecondPos(Pos p) const {
-  // 2^{k-1} if p >= 2^{k-1}; else 0
-  Pos base = ((capacity_ >> 1) & (p - 1)) ^ (capacity_ >> 1);
-  return (base | ((GeneratePos() - 1) >> 1)) + 1;
+  if (capacity_ == 1)
+    return 1;
+  size_t index = capacity_ - 1 + p;
+  while (index > 3)
+    index /= 2;
+  return GeneratePosUnder(index == 2 ? 2 : 1);
 }
 } // namespace dyno::static_path_oheap
@@ -8,6 +8,7 @@
 #include <cstdint>
 #include <map>
 #include <memory>
+#include <string>
 #include <vector>
 
 #include "openssl/rand.h"
@@ -15,6 +16,7 @@
 #include "../../../utils/bytes.h"
 #include "../../../utils/crypto.h"
 #include "../../../store/store.h"
+#include "../../../store/store_pool.h"
 
 namespace dyno::static_path_oheap {
 
@@ -89,21 +91,37 @@ class Bucket {
   void ToBytes(uint8_t *res, size_t val_len);
 };
 
-// Assumes 1-based positions ([1, N]) and power-of-two sizes.
+// Assumes 1-based positions ([1, N]). The tree is heap-shaped with N leaves, so
+// unless N is a power of two they are on the last two levels.
 class OHeap {
  public:
-  OHeap(size_t n, size_t val_len);
+  // RAM, or a store from store_pool, given back on destruction; the pool must
+  // outlive the heap.
+  OHeap(size_t n, size_t val_len, store::StorePool *store_pool = nullptr);
+  // PosixSingleFile, with the top max_levels_in_mem levels in RAM, as in the
+  // static ORAM -- On file store error reverts to RAM store.
+  OHeap(size_t n, size_t val_len, const std::string &file_path,
+        uint8_t max_levels_in_mem = 0);
+  ~OHeap();
 
   Block FindMin(crypto::Key enc_key, bool pad = true);
   Block ExtractMin(crypto::Key enc_key);
   void Insert(Key k, Val v, crypto::Key enc_key);
   void DummyAccess(crypto::Key enc_key, bool with_find_min = true);
   void FillWithDummies(crypto::Key enc_key);
+  // Instead of FillWithDummies, right after allocation: gives all `blocks`
+  // random positions, places them as deep on their paths as they fit, and
+  // writes every bucket once, with its subtree's minimum.
+  void BulkLoad(std::vector<Block> blocks, crypto::Key enc_key);
+  // Reads every bucket that was ever written once, and returns all blocks,
+  // stash included, in no particular order. Leaves the heap empty.
+  std::vector<Block> TakeAll(crypto::Key enc_key);
   [[nodiscard]] size_t Capacity() const { return capacity_; }
   [[nodiscard]] size_t Size() const { return size_; }
   [[nodiscard]] Pos GeneratePos() const;
   [[nodiscard]] unsigned long long MemoryAccessCount() const { return memory_access_count_; }
   [[nodiscard]] unsigned long long MemoryBytesMovedTotal() const { return memory_access_bytes_total_; };
+  [[nodiscard]] bool IsOnDisk() const { return is_on_disk_; }
 
  private:
   size_t capacity_;
@@ -111,7 +129,9 @@ class OHeap {
   size_t val_len_;
   unsigned int depth_;
   size_t num_buckets_;
+  store::StorePool *store_pool_;
   std::unique_ptr<store::Store> store_;
+  bool is_on_disk_ = false;
   std::vector<Block> stash_;
   std::map<Pos, bool> bucket_valid_{};
   unsigned long long memory_access_count_ = 0;
@@ -125,8 +145,12 @@ class OHeap {
   void UpdateMinAndEvict(Pos p, crypto::Key enc_key);
   Block SiblingMin(unsigned int idx, crypto::Key enc_key);
   [[nodiscard]] std::vector<unsigned int> Path(Pos p) const;
-  [[nodiscard]] unsigned int PathAtLevel(Pos p, unsigned int level) const;
+  [[nodiscard]] bool OnPath(Pos p, unsigned int idx) const;
+  // A random position with its leaf under bucket idx.
+  [[nodiscard]] Pos GeneratePosUnder(unsigned int idx) const;
+  // One under each child of the root.
   [[nodiscard]] std::pair<Pos, Pos> GeneratePathPair() const;
+  // One under the other child of the root than p.
   [[nodiscard]] Pos GenerateSecondPos(Pos p) const;
 };
 } // namespace dyno::static_path_oheap
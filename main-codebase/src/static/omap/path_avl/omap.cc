@@ -5,48 +5,145 @@
 #include <cstdint>
 #include <cstddef>
 #include <cmath>
-#include <map>
+#include <cstdlib>
+#include <iostream>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "../../../utils/bytes.h"
 #include "../../../utils/crypto.h"
+#include "../../../utils/fixed_bytes.h"
 #include "../../oram/path/oram.h"
 
 #define max(a, b) ((a)>(b)?(a):(b))
 
 namespace dyno::static_path_omap {
 
-Block::Block(uint8_t *data, size_t val_len) {
+template<typename K>
+Block<K>::Block(uint8_t *data, size_t val_len) {
   if (!data) return;
   bytes::FromBytes(data, meta_);
   val_ = std::make_unique<uint8_t[]>(val_len);
-  std::copy_n(data + sizeof(BlockMetadata), val_len, val_.get());
+  std::copy_n(data + sizeof(BlockMetadata<K>), val_len, val_.get());
 }
 
-ORVal Block::ToBytes(size_t val_len) {
-  ORVal res = std::make_unique<uint8_t[]>(BlockSize(val_len));
+template<typename K>
+ORVal Block<K>::ToBytes(size_t val_len) {
+  ORVal res = std::make_unique<uint8_t[]>(BlockSize<K>(val_len));
   const auto meta_f = reinterpret_cast<const uint8_t *> (std::addressof(meta_));
-  std::copy_n(meta_f, sizeof(BlockMetadata), res.get());
+  std::copy_n(meta_f, sizeof(BlockMetadata<K>), res.get());
   if (val_)
-    std::copy_n(val_.get(), val_len, res.get() + sizeof(BlockMetadata));
+    std::copy_n(val_.get(), val_len, res.get() + sizeof(BlockMetadata<K>));
   return std::move(res);
 }
 
-OMap::OMap(size_t n, size_t val_len, const std::string &path,
-           uint8_t max_levels_in_mem)
+template<typename K>
+typename NodeCache<K>::Entry *NodeCache<K>::FindEntry(ORKey k) {
+  if (!k)
+    return nullptr;
+  // Most lookups are for recently added nodes.
+  for (auto it = slots_.rbegin(); it != slots_.rend(); ++it)
+    if (it->key_ == k)
+      return &*it;
+  return nullptr;
+}
+
+template<typename K>
+Block<K> *NodeCache<K>::Find(ORKey k) {
+  auto e = FindEntry(k);
+  return e ? &e->block_ : nullptr;
+}
+
+template<typename K>
+Block<K> *NodeCache<K>::Add(ORKey k, Block<K> b) {
+  slots_.push_back({k, 0, std::move(b)});
+  ++size_;
+  return &slots_.back().block_;
+}
+
+template<typename K>
+void NodeCache<K>::Erase(ORKey k) {
+  auto e = FindEntry(k);
+  assert(e);
+  e->key_ = 0;
+  e->block_ = Block<K>();
+  --size_;
+}
+
+template<typename K>
+void NodeCache<K>::Reposition(BlockPointer &bp) {
+  if (auto e = FindEntry(bp.key_))
+    bp.pos_ = e->pos_;
+}
+
+template<typename K>
+void NodeCache<K>::Clear() {
+  slots_.clear();
+  size_ = 0;
+}
+
+template<typename K>
+BasicOMap<K>::BasicOMap(size_t n, size_t val_len, const std::string &path,
+                        uint8_t max_levels_in_mem, Options opts)
     : capacity_(n),
       val_len_(val_len),
-      oram_(n, BlockSize(val_len), path, max_levels_in_mem, false, true),
+      oram_(n, BlockSize<K>(val_len), path, max_levels_in_mem, false, true,
+            opts.ORamOptions()),
       max_depth_(ceil(1.44 * log2(n))),
-      pad_val_(ceil(1.44 * 3.0 * log2(n))) {}
+      pad_val_(max(1, ceil(1.44 * 3.0 * log2(n)))),
+      opts_(opts) {}
+
+template<typename K>
+BasicOMap<K>::BasicOMap(size_t n, size_t val_len, std::vector<KeyValPair> kvs,
+                        crypto::Key enc_key, const std::string &path,
+                        uint8_t max_levels_in_mem, Options opts)
+    : BasicOMap(n, val_len, path, max_levels_in_mem, opts) {
+  assert(kvs.size() <= n);
+  for (size_t i = 1; i < kvs.size(); ++i)
+    assert(kvs[i - 1].key_ < kvs[i].key_);
+  std::vector<static_path_oram::Block> blocks;
+  blocks.reserve(kvs.size());
+  root_ = Build(kvs, 0, kvs.size(), 0, blocks);
+  size_ = kvs.size();
+  oram_.BulkLoad(std::move(blocks), enc_key);
+}
+
+// Builds the subtree of kvs[lo, hi), rooted at its middle, children first so
+// their positions are known to the parent. Its height is the bit length of
+// its size, as the halves differ by at most one node.
+template<typename K>
+BlockPointer BasicOMap<K>::Build(std::vector<KeyValPair> &kvs, size_t lo,
+                                 size_t hi, unsigned int depth,
+                                 std::vector<static_path_oram::Block> &blocks) {
+  if (lo == hi)
+    return {0, 0};
+  size_t mid = lo + ((hi - lo) / 2);
+  BlockPointer l = Build(kvs, lo, mid, depth + 1, blocks);
+  BlockPointer r = Build(kvs, mid + 1, hi, depth + 1, blocks);
+  uint32_t height = 0;
+  for (size_t size = hi - lo; size; size >>= 1)
+    ++height;
+
+  BlockPointer res(oram_.NextKey(), oram_.GeneratePos());
+  Block<K> b(kvs[mid].key_, std::move(kvs[mid].val_), l, r, height);
+  b.meta_.size_ = hi - lo;
+  if (depth < opts_.pinned_levels_)
+    pinned_[res.key_] = std::move(b);
+  else
+    blocks.emplace_back(res.pos_, res.key_, b.ToBytes(val_len_));
+  return res;
+}
 
-void OMap::Insert(Key k, Val v, crypto::Key enc_key) {
+template<typename K>
+void BasicOMap<K>::Insert(Key k, Val v, crypto::Key enc_key) {
   auto replacement = Insert(k, v, root_, enc_key);
   root_ = replacement;
-  Finalize(enc_key);
+  Finalize(Op::kInsert, enc_key);
 }
 
-Val OMap::ReadAndRemove(Key k, crypto::Key enc_Key) {
+template<typename K>
+Val BasicOMap<K>::ReadAndRemove(Key k, crypto::Key enc_Key) {
   auto replacement = Delete(k, root_, enc_Key);
   root_ = replacement;
   Val res;
@@ -55,263 +152,559 @@ Val OMap::ReadAndRemove(Key k, crypto::Key enc_Key) {
     res = std::move(delete_res_);
     delete_successful_ = false;
   }
-  Finalize(enc_Key);
+  Finalize(Op::kDelete, enc_Key);
   return std::move(res);
 }
 
-Val OMap::Read(Key k, crypto::Key enc_Key) {
+template<typename K>
+Val BasicOMap<K>::Read(Key k, crypto::Key enc_Key) {
   BlockPointer bp = Find(k, root_, enc_Key);
   Val res;
   if (bp.key_) { // Found
     res = std::make_unique<uint8_t[]>(val_len_);
-    std::copy_n(cache_[bp.key_].val_.get(), val_len_, res.get());
+    std::copy_n(Fetch(bp, enc_Key)->val_.get(), val_len_, res.get());
   }
-  Finalize(enc_Key);
+  Finalize(Op::kRead, enc_Key);
   return std::move(res);
 }
 
-BlockPointer OMap::Insert(Key k, Val &v,
-                          BlockPointer root_bp, crypto::Key enc_key) {
-  if (!root_bp.key_) {
-    root_bp.key_ = oram_.NextKey();
-    cache_[root_bp.key_] = Block(k, std::move(v), 1);
-    ++size_;
-    return root_bp;
-  }
-
-  Block *current_block = Fetch(root_bp, enc_key);
-
-  if (k == current_block->meta_.key_) {
-    current_block->val_ = std::move(v);
-    return root_bp;
+template<typename K>
+Val BasicOMap<K>::ReadOrInsert(Key k, Val v, crypto::Key enc_key) {
+  // The insert walks the path again, but from the cache.
+  BlockPointer bp = Find(k, root_, enc_key);
+  Val res;
+  if (bp.key_) { // Found
+    res = std::make_unique<uint8_t[]>(val_len_);
+    std::copy_n(Fetch(bp, enc_key)->val_.get(), val_len_, res.get());
+  } else {
+    root_ = Insert(k, v, root_, enc_key);
   }
+  Finalize(Op::kInsert, enc_key);
+  return res;
+}
 
-  // key != current_block->key_
-  if (k < current_block->meta_.key_) {
-    BlockPointer r = Insert(k, v, current_block->meta_.l_, enc_key);
-    current_block->meta_.l_ = r;
-  } else { // key > current_block->key_
-    BlockPointer r = Insert(k, v, current_block->meta_.r_, enc_key);
-    current_block->meta_.r_ = r;
+template<typename K>
+std::vector<Val> BasicOMap<K>::ReadBatch(const std::vector<Key> &keys,
+                                         crypto::Key enc_key) {
+  std::vector<Val> res(keys.size());
+  for (unsigned int i = 0; i < keys.size(); ++i) {
+    BlockPointer bp = Find(keys[i], root_, enc_key);
+    if (bp.key_) { // Found
+      res[i] = std::make_unique<uint8_t[]>(val_len_);
+      std::copy_n(Fetch(bp, enc_key)->val_.get(), val_len_, res[i].get());
+    }
   }
+  Finalize(Op::kRead, enc_key, keys.size());
+  return res;
+}
 
-  // Adjust height
-  current_block->meta_.height_ = 1 + max(
-      GetHeight(current_block->meta_.l_, enc_key),
-      GetHeight(current_block->meta_.r_, enc_key));
+template<typename K>
+void BasicOMap<K>::InsertBatch(std::vector<KeyValPair> kvs,
+                               crypto::Key enc_key) {
+  for (auto &kv : kvs)
+    root_ = Insert(kv.key_, kv.val_, root_, enc_key);
+  Finalize(Op::kInsert, enc_key, kvs.size());
+}
 
-  // Finally, balance
-  return Balance(root_bp, enc_key);
+template<typename K>
+std::vector<BasicKeyValPair<K>> BasicOMap<K>::RangeScan(
+    Key lo, Key hi, size_t max_results, crypto::Key enc_key) {
+  auto padding = ScanPadding(max_results);
+  std::vector<KeyValPair> res;
+  if (lo <= hi)
+    Scan(lo, hi, max_results, root_, res, enc_key);
+  Finalize(padding, enc_key);
+  return res;
 }
 
-BlockPointer OMap::Delete(Key k, BlockPointer root_bp, crypto::Key enc_key) {
-  if (!root_bp.key_) // Empty subtree
-    return root_bp;
+template<typename K>
+size_t BasicOMap<K>::Rank(Key k, crypto::Key enc_key) {
+  size_t res = CountLess(k, false, enc_key);
+  Finalize(Op::kInsert, enc_key);
+  return res;
+}
 
-  Block *current_block = Fetch(root_bp, enc_key);
-
-  // First, handle key != current_block->key_
-  if (k < current_block->meta_.key_) {
-    BlockPointer r = Delete(k, cache_[root_bp.key_].meta_.l_, enc_key);
-    cache_[root_bp.key_].meta_.l_ = r;
-    return Balance(root_bp, enc_key);
-  } else if (k > current_block->meta_.key_) {
-    BlockPointer r = Delete(k, cache_[root_bp.key_].meta_.r_, enc_key);
-    cache_[root_bp.key_].meta_.r_ = r;
-    return Balance(root_bp, enc_key);
+template<typename K>
+BasicKeyValPair<K> BasicOMap<K>::Select(size_t i, crypto::Key enc_key) {
+  KeyValPair res(Key(), nullptr);
+  BlockPointer bp = root_;
+  while (bp.key_) {
+    Block<K> *current_block = Fetch(bp, enc_key);
+    size_t l_size = GetSize(current_block->meta_.l_, enc_key);
+    if (i == l_size) {
+      res.key_ = current_block->meta_.key_;
+      res.val_ = std::make_unique<uint8_t[]>(val_len_);
+      std::copy_n(current_block->val_.get(), val_len_, res.val_.get());
+      break;
+    }
+    if (i < l_size) {
+      bp = current_block->meta_.l_;
+    } else {
+      i -= l_size + 1;
+      bp = current_block->meta_.r_;
+    }
   }
+  Finalize(Op::kInsert, enc_key);
+  return res;
+}
 
-  // key == current_block->key_
-  if (!delete_successful_) {
-    delete_res_ = std::move(current_block->val_);
-    delete_successful_ = true;
-  } // Else the actual node had two children, and we're deleting the successor.
-
-  auto lk = current_block->meta_.l_.key_;
-  auto rk = current_block->meta_.r_.key_;
+template<typename K>
+size_t BasicOMap<K>::CountRange(Key lo, Key hi, crypto::Key enc_key) {
+  size_t below_lo = CountLess(lo, false, enc_key);
+  size_t up_to_hi = CountLess(hi, true, enc_key);
+  Finalize(Op::kInsert, enc_key, 2);
+  return up_to_hi > below_lo ? up_to_hi - below_lo : 0;
+}
 
-  // - No children
-  if (!lk && !rk) {
-    cache_.erase(root_bp.key_);
-    oram_.AddFreedKey(root_bp.key_);
-    return {0, 0};
+template<typename K>
+BlockPointer BasicOMap<K>::Insert(Key k, Val &v,
+                                  BlockPointer root_bp, crypto::Key enc_key) {
+  std::vector<Step> path;
+  BlockPointer bp = root_bp;
+  while (bp.key_) {
+    Block<K> *current_block = Fetch(bp, enc_key);
+    if (k == current_block->meta_.key_) {
+      current_block->val_ = std::move(v);
+      return root_bp;
+    }
+    bool left = k < current_block->meta_.key_;
+    path.push_back({bp, left});
+    bp = left ? current_block->meta_.l_ : current_block->meta_.r_;
   }
 
-  // - One child
-  if (lk && !rk) { // Has left child
-    BlockPointer r = current_block->meta_.l_;
-    cache_.erase(root_bp.key_);
-    oram_.AddFreedKey(root_bp.key_);
-    return r;
+  bp = {oram_.NextKey(), 0};
+  cache_.Add(bp.key_, Block<K>(k, std::move(v), 1));
+  ++size_;
+  return Unwind(path, bp, enc_key);
+}
+
+template<typename K>
+BlockPointer BasicOMap<K>::Delete(Key k, BlockPointer root_bp,
+                                  crypto::Key enc_key) {
+  std::vector<Step> path;
+  BlockPointer bp = root_bp;
+  Block<K> *current_block = nullptr;
+  while (bp.key_) {
+    current_block = Fetch(bp, enc_key);
+    if (k == current_block->meta_.key_)
+      break;
+    bool left = k < current_block->meta_.key_;
+    path.push_back({bp, left});
+    bp = left ? current_block->meta_.l_ : current_block->meta_.r_;
   }
-  if (!lk && rk) { // Has right child
-    BlockPointer r = current_block->meta_.r_;
-    cache_.erase(root_bp.key_);
-    oram_.AddFreedKey(root_bp.key_);
-    return r;
+  if (!bp.key_) // Not found
+    return root_bp;
+
+  delete_res_ = std::move(current_block->val_);
+  delete_successful_ = true;
+
+  // - At most one child: the child takes the node's place.
+  auto l = current_block->meta_.l_;
+  auto r = current_block->meta_.r_;
+  if (!l.key_ || !r.key_) {
+    FreeNode(bp);
+    return Unwind(path, l.key_ ? l : r, enc_key);
   }
 
-  // - Two children
-  //   1. Find the successor
-  unsigned int max_search_time = max_depth_;
-  BlockPointer it = current_block->meta_.r_;
-  Block *rpl;
-  while (max_search_time--) {
-    rpl = Fetch(it, enc_key);
-    if (!rpl->meta_.l_.key_)
-      break;
+  // - Two children: the successor's key and value move to the node, and the
+  //   successor is replaced by its right child.
+  path.push_back({bp, false});
+  BlockPointer it = r;
+  Block<K> *rpl = Fetch(it, enc_key);
+  while (rpl->meta_.l_.key_) {
+    path.push_back({it, true});
     it = rpl->meta_.l_;
+    rpl = Fetch(it, enc_key);
   }
-
-  //   2. Set current node's value to the successor's
   current_block->meta_.key_ = rpl->meta_.key_;
   current_block->val_ = std::move(rpl->val_);
-
-  //   3. Delete the successor
-  // This is done like this because the balancing of the replacement node may
-  // cascade to its parents.
-  current_block->meta_.r_ = Delete(rpl->meta_.key_,
-                                   current_block->meta_.r_, enc_key);
-  return Balance(root_bp, enc_key);
+  BlockPointer replacement = rpl->meta_.r_;
+  FreeNode(it);
+  return Unwind(path, replacement, enc_key);
 }
 
-Block empty; // Hack! TODO: Fix
-Block *OMap::Fetch(BlockPointer bp, crypto::Key enc_key) {
-  if (!bp.key_) {
-    empty = Block();
-    return &empty;
+// Puts `child` in place of the child the last step went to, then fixes the
+// heights and balance of the path bottom-up. Returns the new root.
+template<typename K>
+BlockPointer BasicOMap<K>::Unwind(const std::vector<Step> &path,
+                                  BlockPointer child, crypto::Key enc_key) {
+  for (auto step = path.rbegin(); step != path.rend(); ++step) {
+    Block<K> *current_block = Fetch(step->bp_, enc_key);
+    if (step->left_)
+      current_block->meta_.l_ = child;
+    else
+      current_block->meta_.r_ = child;
+    auto lh = GetHeight(current_block->meta_.l_, enc_key);
+    auto rh = GetHeight(current_block->meta_.r_, enc_key);
+    current_block->meta_.height_ = 1 + max(lh, rh);
+    current_block->meta_.size_ = 1 + GetSize(current_block->meta_.l_, enc_key)
+        + GetSize(current_block->meta_.r_, enc_key);
+    child = Balance(step->bp_, enc_key);
   }
+  return child;
+}
+
+template<typename K>
+void BasicOMap<K>::FreeNode(BlockPointer bp) {
+  if (!pinned_.erase(bp.key_))
+    cache_.Erase(bp.key_);
+  oram_.AddFreedKey(bp.key_);
+}
 
-  if (cache_.find(bp.key_) != cache_.end()) { // Found in cache
-    return &cache_[bp.key_];
+template<typename K>
+Block<K> *BasicOMap<K>::Fetch(BlockPointer bp, crypto::Key enc_key) {
+  assert(bp.key_);
+  if (!pinned_.empty()) {
+    auto it = pinned_.find(bp.key_);
+    if (it != pinned_.end())
+      return &it->second;
   }
+  if (auto cached = cache_.Find(bp.key_)) // Found in cache
+    return cached;
 
   assert(bp.pos_);
   ++accesses_before_finalize_;
   auto orb = oram_.ReadAndRemove(bp.pos_, bp.key_, enc_key);
-  Block res(orb.val_.get(), val_len_);
-  cache_[bp.key_] = std::move(res);
-  return &cache_[bp.key_];
+  return cache_.Add(bp.key_, Block<K>(orb.val_.get(), val_len_));
 }
 
-BlockPointer OMap::Balance(BlockPointer root_bp, crypto::Key enc_key) {
+template<typename K>
+BlockPointer BasicOMap<K>::Balance(BlockPointer root_bp, crypto::Key enc_key) {
   auto bf = BalanceFactor(root_bp, enc_key);
   if (-1 <= bf && bf <= 1) // No rebalance necessary.
     return root_bp;
 
-  Block &current_block = cache_[root_bp.key_];
+  Block<K> *current_block = Fetch(root_bp, enc_key);
   if (bf < -1) { //         Left-heavy
-    auto l_bf = BalanceFactor(current_block.meta_.l_, enc_key);
+    auto l_bf = BalanceFactor(current_block->meta_.l_, enc_key);
     if (l_bf > 0) //        left-right
-      current_block.meta_.l_ = RotateLeft(current_block.meta_.l_, enc_key);
+      current_block->meta_.l_ = RotateLeft(current_block->meta_.l_, enc_key);
     return RotateRight(root_bp, enc_key);
   }
   //                        Right-heavy
-  auto r_bf = BalanceFactor(current_block.meta_.r_, enc_key);
+  auto r_bf = BalanceFactor(current_block->meta_.r_, enc_key);
   if (r_bf < 0) //          right-left
-    current_block.meta_.r_ = RotateRight(current_block.meta_.r_, enc_key);
+    current_block->meta_.r_ = RotateRight(current_block->meta_.r_, enc_key);
   return RotateLeft(root_bp, enc_key);
 }
 
-int8_t OMap::BalanceFactor(BlockPointer bp, crypto::Key enc_key) {
+template<typename K>
+int8_t BasicOMap<K>::BalanceFactor(BlockPointer bp, crypto::Key enc_key) {
   auto current_node = Fetch(bp, enc_key);
   auto lh = GetHeight(current_node->meta_.l_, enc_key);
   auto rh = GetHeight(current_node->meta_.r_, enc_key);
   return rh - lh;
 }
 
-uint8_t OMap::GetHeight(BlockPointer bp, crypto::Key enc_key) {
+template<typename K>
+uint8_t BasicOMap<K>::GetHeight(BlockPointer bp, crypto::Key enc_key) {
   if (!bp.key_)
     return 0;
   return Fetch(bp, enc_key)->meta_.height_;
 }
 
-BlockPointer OMap::RotateLeft(BlockPointer root_bp, crypto::Key enc_key) {
+template<typename K>
+uint32_t BasicOMap<K>::GetSize(BlockPointer bp, crypto::Key enc_key) {
+  if (!bp.key_)
+    return 0;
+  return Fetch(bp, enc_key)->meta_.size_;
+}
+
+template<typename K>
+BlockPointer BasicOMap<K>::RotateLeft(BlockPointer root_bp,
+                                      crypto::Key enc_key) {
   auto p = Fetch(root_bp, enc_key);
-  auto l = Fetch(p->meta_.l_, enc_key);
   auto r = Fetch(p->meta_.r_, enc_key);
-  auto rl = Fetch(r->meta_.l_, enc_key);
-  auto rr = Fetch(r->meta_.r_, enc_key);
+  auto lh = GetHeight(p->meta_.l_, enc_key);
+  auto rlh = GetHeight(r->meta_.l_, enc_key);
+  auto rrh = GetHeight(r->meta_.r_, enc_key);
 
   auto res = p->meta_.r_;
   p->meta_.r_ = r->meta_.l_;
-  p->meta_.height_ = 1 + max(l->meta_.height_, rl->meta_.height_);
+  p->meta_.height_ = 1 + max(lh, rlh);
+  p->meta_.size_ = 1 + GetSize(p->meta_.l_, enc_key)
+      + GetSize(p->meta_.r_, enc_key);
   r->meta_.l_ = root_bp;
-  r->meta_.height_ = 1 + max(p->meta_.height_, rr->meta_.height_);
+  r->meta_.height_ = 1 + max(p->meta_.height_, rrh);
+  r->meta_.size_ = 1 + p->meta_.size_ + GetSize(r->meta_.r_, enc_key);
   return res;
 }
 
-BlockPointer OMap::RotateRight(BlockPointer root_bp, crypto::Key enc_key) {
+template<typename K>
+BlockPointer BasicOMap<K>::RotateRight(BlockPointer root_bp,
+                                       crypto::Key enc_key) {
   auto p = Fetch(root_bp, enc_key);
   auto l = Fetch(p->meta_.l_, enc_key);
-  auto r = Fetch(p->meta_.r_, enc_key);
-  auto ll = Fetch(l->meta_.l_, enc_key);
-  auto lr = Fetch(l->meta_.r_, enc_key);
+  auto rh = GetHeight(p->meta_.r_, enc_key);
+  auto llh = GetHeight(l->meta_.l_, enc_key);
+  auto lrh = GetHeight(l->meta_.r_, enc_key);
 
   auto res = p->meta_.l_;
   p->meta_.l_ = l->meta_.r_;
-  p->meta_.height_ = 1 + max(lr->meta_.height_, r->meta_.height_);
+  p->meta_.height_ = 1 + max(lrh, rh);
+  p->meta_.size_ = 1 + GetSize(p->meta_.l_, enc_key)
+      + GetSize(p->meta_.r_, enc_key);
   l->meta_.r_ = root_bp;
-  l->meta_.height_ = 1 + max(ll->meta_.height_, p->meta_.height_);
+  l->meta_.height_ = 1 + max(llh, p->meta_.height_);
+  l->meta_.size_ = 1 + GetSize(l->meta_.l_, enc_key) + p->meta_.size_;
   return res;
 }
 
-void OMap::Finalize(crypto::Key enc_key) {
+// A lookup reads (and writes back) one root-to-node path. An insert also reads
+// the sibling of every node on its path, for heights and rotations, and
+// writes one new node. Deletes may further need the children of siblings for
+// rotations, and get the bound of any operation.
+//
+// A batch of num_ops operations is padded to num_ops times that, but never to
+// more than the number of blocks, as each block is read and written at most
+// once per batch.
+template<typename K>
+typename BasicOMap<K>::Padding BasicOMap<K>::PaddingFor(Op op,
+                                                        size_t num_ops) const {
+  uint32_t depth = max(1, max_depth_);
+  Padding res{2 * depth, 2 * depth};
+  if (!opts_.pad_per_op_ || op == Op::kDelete)
+    res = {pad_val_, pad_val_};
+  else if (op == Op::kRead)
+    res = {depth, depth};
+  if (opts_.pinned_levels_)
+    res = PinnedPadding(opts_.pad_per_op_ ? op : Op::kDelete);
+  if (num_ops > 1) {
+    res.reads_ = std::min(num_ops * res.reads_, max(res.reads_, capacity_));
+    res.writes_ = std::min(num_ops * res.writes_, max(res.writes_, capacity_));
+  }
+  return res;
+}
+
+// With the top k levels pinned, only the touched nodes below them are
+// fetched: at most depth - k per walked path, i.e. the path itself for
+// lookups, also its siblings for inserts, and also their children for deletes
+// (plus one, as the children of pinned siblings need not be pinned). Then
+// come the nodes rotations move into the pinned levels, which are fetched,
+// and out of them, which are written back; no more than the levels can hold.
+template<typename K>
+typename BasicOMap<K>::Padding BasicOMap<K>::PinnedPadding(Op op) const {
+  uint32_t k = opts_.pinned_levels_;
+  uint32_t depth = max(1, max_depth_);
+  uint32_t below = depth > k ? depth - k : 0;
+  switch (op) {
+    case Op::kRead:
+      return {below, below};
+    case Op::kInsert: {
+      uint32_t reads = (2 * below) + (k >= 3 ? 1U << (k - 2) : 0);
+      return {reads, reads + (1U << (k - 1))};
+    }
+    default: {
+      uint32_t reads = (3 * below) + 1 + ((1U << k) - 1);
+      return {reads, reads + (1U << (k - 1))};
+    }
+  }
+}
+
+// Apart from the results, a scan only reads nodes on the path to lo, and
+// ancestors of the last result (or nodes on the path to hi).
+template<typename K>
+typename BasicOMap<K>::Padding BasicOMap<K>::ScanPadding(
+    size_t max_results) const {
+  uint32_t depth = max(1, max_depth_);
+  size_t results = std::min(max_results, capacity_);
+  uint32_t bound = std::min(2 * depth + results, max(depth, capacity_));
+  return {bound, bound};
+}
+
+template<typename K>
+void BasicOMap<K>::Finalize(Op op, crypto::Key enc_key, size_t num_ops) {
+  Finalize(PaddingFor(op, num_ops), enc_key);
+}
+
+template<typename K>
+void BasicOMap<K>::Finalize(Padding padding, crypto::Key enc_key) {
+  if (opts_.pinned_levels_)
+    Repin(enc_key);
+  CheckPadding(accesses_before_finalize_, padding.reads_, "reads");
   // Pad reads
-  for (unsigned int i = accesses_before_finalize_; i < pad_val_; ++i)
+  for (unsigned int i = accesses_before_finalize_; i < padding.reads_; ++i)
     oram_.DummyAccess(enc_key);
   accesses_before_finalize_ = 0;
 
-  // Re-position and re-write all cached
-  std::map<ORKey, ORPos> pos_map;
-  for (auto &c : cache_) {
-    ORKey ok = c.first;
-    pos_map[ok] = oram_.GeneratePos();
+  // Re-position all cached and write them back with one batched eviction
+  for (auto &e : cache_)
+    if (e.key_)
+      e.pos_ = oram_.GeneratePos();
+  cache_.Reposition(root_);
+  for (auto &p : pinned_) {
+    cache_.Reposition(p.second.meta_.l_);
+    cache_.Reposition(p.second.meta_.r_);
   }
 
-  if (pos_map.find(root_.key_) != pos_map.end())
-    root_.pos_ = pos_map[root_.key_];
-
-  for (auto &c : cache_) {
-    ORKey ok = c.first;
-    ORPos op = pos_map[ok];
-    auto &b = c.second;
-    if (pos_map.find(b.meta_.l_.key_) != pos_map.end())
-      b.meta_.l_.pos_ = pos_map[b.meta_.l_.key_];
-    if (pos_map.find(b.meta_.r_.key_) != pos_map.end())
-      b.meta_.r_.pos_ = pos_map[b.meta_.r_.key_];
-    auto ov = b.ToBytes(val_len_);
-    b.val_.reset(); // release memory -- can do at the end too.
-    oram_.Insert({op, ok, std::move(ov)}, enc_key);
+  std::vector<static_path_oram::Block> blocks;
+  blocks.reserve(cache_.Size());
+  for (auto &e : cache_) {
+    if (!e.key_) // Freed
+      continue;
+    auto &b = e.block_;
+    cache_.Reposition(b.meta_.l_);
+    cache_.Reposition(b.meta_.r_);
+    blocks.emplace_back(e.pos_, e.key_, b.ToBytes(val_len_));
   }
-  auto writes_done = cache_.size();
-  cache_.clear();
+  cache_.Clear();
 
   // Pad writes
-  while (writes_done++ < pad_val_)
-    oram_.DummyAccess(enc_key);
+  CheckPadding(blocks.size(), padding.writes_, "writes");
+  oram_.InsertBatch(std::move(blocks), padding.writes_, enc_key);
 }
 
-BlockPointer OMap::Find(Key key, BlockPointer root_bp, crypto::Key enc_key) {
-  if (!root_bp.key_) // Not found;
-    return root_bp;
-  Block *current_block = Fetch(root_bp, enc_key);
-  if (key == current_block->meta_.key_)
-    return root_bp;
-  if (key < current_block->meta_.key_)
-    return Find(key, current_block->meta_.l_, enc_key);
-  return Find(key, current_block->meta_.r_, enc_key);
+// Going past the padding would show in the number of accesses, so it is a
+// bug even in release builds.
+template<typename K>
+void BasicOMap<K>::CheckPadding(size_t done, size_t bound, const char *what) {
+  if (done <= bound)
+    return;
+  std::cerr << "OMap operation made " << done << " " << what
+            << ", over its padding of " << bound << "." << std::endl;
+  std::abort();
+}
+
+// Pins the nodes now in the top levels, fetching those that rotations moved
+// there, and hands those that left them to the cache, to be written back.
+template<typename K>
+void BasicOMap<K>::Repin(crypto::Key enc_key) {
+  std::vector<ORKey> top;
+  std::vector<BlockPointer> level;
+  if (root_.key_)
+    level.push_back(root_);
+  for (unsigned int d = 0; d < opts_.pinned_levels_ && !level.empty(); ++d) {
+    std::vector<BlockPointer> next;
+    for (auto bp : level) {
+      Block<K> *current_block = Fetch(bp, enc_key);
+      top.push_back(bp.key_);
+      if (current_block->meta_.l_.key_)
+        next.push_back(current_block->meta_.l_);
+      if (current_block->meta_.r_.key_)
+        next.push_back(current_block->meta_.r_);
+    }
+    level = std::move(next);
+  }
+
+  std::unordered_map<ORKey, Block<K>> pinned;
+  for (auto k : top) {
+    auto it = pinned_.find(k);
+    if (it != pinned_.end()) {
+      pinned[k] = std::move(it->second);
+      pinned_.erase(it);
+    } else {
+      pinned[k] = std::move(*cache_.Find(k));
+      cache_.Erase(k);
+    }
+  }
+  for (auto &p : pinned_) // No longer in the top levels.
+    cache_.Add(p.first, std::move(p.second));
+  pinned_ = std::move(pinned);
+}
+
+template<typename K>
+BlockPointer BasicOMap<K>::Find(Key key, BlockPointer root_bp,
+                                crypto::Key enc_key) {
+  BlockPointer bp = root_bp;
+  while (bp.key_) {
+    Block<K> *current_block = Fetch(bp, enc_key);
+    if (key == current_block->meta_.key_)
+      break;
+    bp = key < current_block->meta_.key_ ? current_block->meta_.l_
+                                         : current_block->meta_.r_;
+  }
+  return bp;
+}
+
+// Going right past a node counts it and its left subtree.
+template<typename K>
+size_t BasicOMap<K>::CountLess(Key k, bool or_equal, crypto::Key enc_key) {
+  size_t res = 0;
+  BlockPointer bp = root_;
+  while (bp.key_) {
+    Block<K> *current_block = Fetch(bp, enc_key);
+    Key node_key = current_block->meta_.key_;
+    if (node_key < k || (or_equal && node_key == k)) {
+      res += 1 + GetSize(current_block->meta_.l_, enc_key);
+      bp = current_block->meta_.r_;
+    } else {
+      bp = current_block->meta_.l_;
+    }
+  }
+  return res;
+}
+
+// In-order walk of the nodes that may hold keys in [lo, hi], stopping at
+// max_results. `ancestors` holds the nodes whose left subtree is being walked.
+template<typename K>
+void BasicOMap<K>::Scan(Key lo, Key hi, size_t max_results,
+                        BlockPointer root_bp, std::vector<KeyValPair> &res,
+                        crypto::Key enc_key) {
+  std::vector<BlockPointer> ancestors;
+  BlockPointer bp = root_bp;
+  while ((bp.key_ || !ancestors.empty()) && res.size() < max_results) {
+    if (bp.key_) {
+      Block<K> *current_block = Fetch(bp, enc_key);
+      ancestors.push_back(bp);
+      bp = lo < current_block->meta_.key_ ? current_block->meta_.l_
+                                          : BlockPointer(0, 0);
+      continue;
+    }
+    Block<K> *current_block = Fetch(ancestors.back(), enc_key);
+    ancestors.pop_back();
+    Key k = current_block->meta_.key_;
+    if (lo <= k && k <= hi) {
+      Val v = std::make_unique<uint8_t[]>(val_len_);
+      std::copy_n(current_block->val_.get(), val_len_, v.get());
+      res.emplace_back(k, std::move(v));
+    }
+    bp = k < hi ? current_block->meta_.r_ : BlockPointer(0, 0);
+  }
 }
 
-KeyValPair OMap::TakeOne(crypto::Key enc_key) {
-  Block *root_block = Fetch(root_, enc_key);
-  auto key = root_block->meta_.key_;
-  auto val = ReadAndRemove(root_block->meta_.key_, enc_key);
+template<typename K>
+BasicKeyValPair<K> BasicOMap<K>::TakeOne(crypto::Key enc_key) {
+  Key key{};
+  if (root_.key_)
+    key = Fetch(root_, enc_key)->meta_.key_;
+  auto val = ReadAndRemove(key, enc_key);
   return {key, std::move(val)};
 }
 
+template<typename K>
+std::vector<BasicKeyValPair<K>> BasicOMap<K>::TakeAll(crypto::Key enc_key) {
+  std::vector<KeyValPair> res;
+  res.reserve(size_);
+  for (auto &b : oram_.TakeAll(enc_key)) {
+    Block<K> node(b.val_.get(), val_len_);
+    res.emplace_back(node.meta_.key_, std::move(node.val_));
+  }
+  for (auto &p : pinned_)
+    res.emplace_back(p.second.meta_.key_, std::move(p.second.val_));
+  pinned_.clear();
+  std::sort(res.begin(), res.end(),
+            [](const KeyValPair &a, const KeyValPair &b) {
+              return a.key_ < b.key_;
+            });
+  root_ = {0, 0};
+  size_ = 0;
+  return res;
+}
+
+template<typename K>
+void BasicOMap<K>::Dummy(Op op, crypto::Key enc_key) {
+  Finalize(op, enc_key);
+}
+
 // Should only be called after allocation.
-void OMap::FillWithDummies(crypto::Key enc_key) {
+template<typename K>
+void BasicOMap<K>::FillWithDummies(crypto::Key enc_key) {
   oram_.FillWithDummies(enc_key);
 }
+template class BasicOMap<uint32_t>;
+template class BasicOMap<uint64_t>;
+template class BasicOMap<bytes::FixedBytes<16>>;
+template class BasicOMap<bytes::FixedBytes<32>>;
+template class BasicOMap<bytes::FixedBytes<16, true>>;
+template class BasicOMap<bytes::FixedBytes<32, true>>;
 } // namespace dyno::static_path_omap
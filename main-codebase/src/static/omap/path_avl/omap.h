@@ -3,14 +3,18 @@
 
 #include <cstdint>
 #include <cstddef>
-#include <map>
+#include <deque>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "../../../utils/crypto.h"
+#include "../../../utils/fixed_bytes.h"
 #include "../../oram/path/oram.h"
 
 namespace dyno::static_path_omap {
 
+// The default key type; BasicOMap also takes the key types below.
 using Key = uint32_t;
 using Val = std::unique_ptr<uint8_t[]>;
 
@@ -19,15 +23,18 @@ using ORPos = static_path_oram::Pos;
 using ORVal = static_path_oram::Val;
 using PathORam = static_path_oram::ORam;
 
-class KeyValPair {
+template<typename K>
+class BasicKeyValPair {
  public:
-  Key key_;
+  K key_;
   Val val_;
 
-  KeyValPair() = default;
-  KeyValPair(Key k, Val v) : key_(k), val_(std::move(v)) {}
+  BasicKeyValPair() = default;
+  BasicKeyValPair(K k, Val v) : key_(k), val_(std::move(v)) {}
 };
 
+using KeyValPair = BasicKeyValPair<Key>;
+
 class BlockPointer {
  public:
   ORKey key_;
@@ -37,45 +44,148 @@ class BlockPointer {
   BlockPointer(ORKey k, ORPos p) : key_(k), pos_(p) {}
 };
 
+// K is copied into the ORAM blocks as is, so it must be trivially copyable.
+template<typename K>
 class BlockMetadata {
  public:
-  Key key_ = 0;
+  K key_{};
   BlockPointer l_{0, 0}, r_{0, 0};
+  uint32_t size_ = 1; // Nodes in its subtree, for order statistics.
   uint8_t height_ = 0;
 
   BlockMetadata() = default;
-  BlockMetadata(Key k, uint32_t h) : key_(k), height_(h) {}
-  BlockMetadata(Key k, BlockPointer l, BlockPointer r, uint32_t h)
+  BlockMetadata(K k, uint32_t h) : key_(k), height_(h) {}
+  BlockMetadata(K k, BlockPointer l, BlockPointer r, uint32_t h)
       : key_(k), l_(l), r_(r), height_(h) {}
 };
 
+template<typename K>
 class Block {
  public:
-  BlockMetadata meta_;
+  BlockMetadata<K> meta_;
   Val val_;
 
   Block() = default;
-  Block(Key k, Val v, uint32_t h) : meta_(k, h), val_(std::move(v)) {}
-  Block(Key k, Val v, BlockPointer l, BlockPointer r, uint32_t h)
+  Block(K k, Val v, uint32_t h) : meta_(k, h), val_(std::move(v)) {}
+  Block(K k, Val v, BlockPointer l, BlockPointer r, uint32_t h)
       : meta_(k, l, r, h), val_(std::move(v)) {}
   Block(uint8_t *data, size_t val_len);
 
   ORVal ToBytes(size_t val_len);
 };
 
+template<typename K>
 static size_t BlockSize(size_t val_len) {
-  return sizeof(BlockMetadata) + val_len;
+  return sizeof(BlockMetadata<K>) + val_len;
 }
 
-class OMap {
+// The nodes fetched or created by one operation, in insertion order. Slots are
+// in a deque, so they do not move when one is added, and pointers to nodes stay
+// valid until Clear.
+// Lookups scan the slots, as an operation touches O(log n) nodes.
+template<typename K>
+class NodeCache {
+ public:
+  class Entry {
+   public:
+    ORKey key_ = 0; // 0 once erased.
+    ORPos pos_ = 0; // Given on write-back.
+    Block<K> block_;
+  };
+
+  Entry *FindEntry(ORKey k);
+  Block<K> *Find(ORKey k);
+  Block<K> *Add(ORKey k, Block<K> b);
+  void Erase(ORKey k);
+  // Points bp to the position of its node, if cached.
+  void Reposition(BlockPointer &bp);
+  void Clear();
+  [[nodiscard]] size_t Size() const { return size_; }
+  typename std::deque<Entry>::iterator begin() { return slots_.begin(); }
+  typename std::deque<Entry>::iterator end() { return slots_.end(); }
+
+ private:
+  std::deque<Entry> slots_;
+  size_t size_ = 0; // Entries not erased.
+};
+
+// Kinds of operations, each with its own worst case number of ORAM accesses.
+enum class Op { kRead, kInsert, kDelete };
+
+class Options {
  public:
+  // Pad every operation only up to the worst case of its kind, instead of the
+  // worst case of any kind. Lookups get much cheaper, but the kind of every
+  // operation is revealed.
+  bool pad_per_op_ = false;
+  // Keep the top levels of the tree in client memory, in plaintext. Lookups
+  // then fetch that many fewer nodes. Rotations near the root can move nodes
+  // into or out of those levels, and the bounds include the worst case:
+  // inserts fetch up to 2^(k-2) and deletes up to 2^k - 1 more nodes, and
+  // both write up to 2^(k-1) more. So only small values pay off, and mostly
+  // with pad_per_op_.
+  uint8_t pinned_levels_ = 0;
+  // Passed on to the ORAM, see static_path_oram::Options.
+  store::StorePool *store_pool_ = nullptr;
+
+  [[nodiscard]] static_path_oram::Options ORamOptions() const {
+    static_path_oram::Options res;
+    res.store_pool_ = store_pool_;
+    return res;
+  }
+};
+
+// An oblivious AVL tree over a Path ORAM, one node per block. K is the key
+// type: uint32_t (the OMap alias), uint64_t, or bytes::FixedBytes<16> or <32>
+// with either comparison; others need an explicit instantiation in omap.cc.
+// TakeOne returns the null key K{} for an empty map.
+template<typename K>
+class BasicOMap {
+ public:
+  using Key = K;
+  using KeyValPair = BasicKeyValPair<K>;
+
   // PosixSingleFile -- On file store error reverts to RAM store.
-  OMap(size_t n, size_t val_len, const std::string &file_path = "",
-       uint8_t max_levels_in_mem = 0);
+  BasicOMap(size_t n, size_t val_len, const std::string &file_path = "",
+            uint8_t max_levels_in_mem = 0, Options opts = Options());
+  // Bulk build from `kvs`, sorted by strictly increasing keys (at most n of
+  // them): the tree is perfectly balanced, and its nodes are written with one
+  // pass over the ORAM. Replaces FillWithDummies.
+  BasicOMap(size_t n, size_t val_len, std::vector<KeyValPair> kvs,
+            crypto::Key enc_key, const std::string &file_path = "",
+            uint8_t max_levels_in_mem = 0, Options opts = Options());
   void Insert(Key k, Val v, crypto::Key enc_key);
   Val Read(Key k, crypto::Key enc_Key);
   Val ReadAndRemove(Key k, crypto::Key enc_Key);
+  // Inserts (k, v) if k is missing; else returns its value and leaves the map
+  // as is. Padded as an insert either way.
+  Val ReadOrInsert(Key k, Val v, crypto::Key enc_key);
+  // Batched versions of Read and Insert. All keys are looked up against one
+  // node cache, so nodes shared by their paths are read once, and the batch
+  // is padded and written back once, for |keys| operations of its kind.
+  std::vector<Val> ReadBatch(const std::vector<Key> &keys,
+                             crypto::Key enc_key);
+  void InsertBatch(std::vector<KeyValPair> kvs, crypto::Key enc_key);
+  // Up to max_results pairs with keys in [lo, hi], in key order. Always padded
+  // to 2 * max_depth + max_results reads and writes, whatever the options, so
+  // scans with the same max_results look alike (but not like point accesses).
+  std::vector<KeyValPair> RangeScan(Key lo, Key hi, size_t max_results,
+                                    crypto::Key enc_key);
+  // Order statistics. Each walks one path and reads the left child of every
+  // node on it, and is padded as an insert (CountRange as two).
+  // The number of keys less than k.
+  size_t Rank(Key k, crypto::Key enc_key);
+  // The pair with the i-th smallest key, from 0; the null key past the end.
+  KeyValPair Select(size_t i, crypto::Key enc_key);
+  // The number of keys in [lo, hi].
+  size_t CountRange(Key lo, Key hi, crypto::Key enc_key);
   KeyValPair TakeOne(crypto::Key enc_key);
+  // All pairs, in key order, read with one pass over the ORAM (see
+  // PathORam::TakeAll). Leaves the map empty. With the bulk build, this
+  // rebuilds a map at another size.
+  std::vector<KeyValPair> TakeAll(crypto::Key enc_key);
+  // Looks like an operation of kind `op`, without touching the map.
+  void Dummy(Op op, crypto::Key enc_key);
   void FillWithDummies(crypto::Key enc_key);
   [[nodiscard]] size_t Capacity() const { return capacity_; }
   [[nodiscard]] size_t Size() const { return size_; }
@@ -84,29 +194,67 @@ class OMap {
   [[nodiscard]] bool IsOnDisk() const { return oram_.IsOnDisk(); }
 
  private:
+  // Number of ORAM reads and writes an operation is padded to.
+  class Padding {
+   public:
+    uint32_t reads_;
+    uint32_t writes_;
+  };
+
+  // A node on the path walked by Insert or Delete, and the side it was left
+  // by.
+  class Step {
+   public:
+    BlockPointer bp_;
+    bool left_;
+  };
+
   const size_t capacity_;
   const size_t val_len_;
   const uint32_t max_depth_;
   const uint32_t pad_val_;
+  const Options opts_;
   size_t size_ = 0;
   PathORam oram_;
   BlockPointer root_ = BlockPointer(0, 0); // Can and will change.
   uint32_t accesses_before_finalize_ = 0;
-  std::map<ORKey, Block> cache_;
+  NodeCache<K> cache_;
+  // The top opts_.pinned_levels_.
+  std::unordered_map<ORKey, Block<K>> pinned_;
   Val delete_res_;
   bool delete_successful_ = false;
 
+  BlockPointer Build(std::vector<KeyValPair> &kvs, size_t lo, size_t hi,
+                     unsigned int depth,
+                     std::vector<static_path_oram::Block> &blocks);
   BlockPointer Insert(Key k, Val &v, BlockPointer root, crypto::Key enc_key);
   BlockPointer Delete(Key k, BlockPointer root, crypto::Key enc_key);
-  Block *Fetch(BlockPointer bp, crypto::Key enc_key);
+  BlockPointer Unwind(const std::vector<Step> &path, BlockPointer child,
+                      crypto::Key enc_key);
+  void FreeNode(BlockPointer bp);
+  Block<K> *Fetch(BlockPointer bp, crypto::Key enc_key);
   BlockPointer Balance(BlockPointer root, crypto::Key enc_key);
   int8_t BalanceFactor(BlockPointer bp, crypto::Key enc_key);
   uint8_t GetHeight(BlockPointer bp, crypto::Key enc_key);
+  uint32_t GetSize(BlockPointer bp, crypto::Key enc_key);
   BlockPointer RotateLeft(BlockPointer root, crypto::Key enc_key);
   BlockPointer RotateRight(BlockPointer root, crypto::Key enc_key);
-  void Finalize(crypto::Key enc_key);
+  [[nodiscard]] Padding PaddingFor(Op op, size_t num_ops = 1) const;
+  [[nodiscard]] Padding PinnedPadding(Op op) const;
+  [[nodiscard]] Padding ScanPadding(size_t max_results) const;
+  void Finalize(Op op, crypto::Key enc_key, size_t num_ops = 1);
+  void Finalize(Padding padding, crypto::Key enc_key);
+  // Aborts if done > bound, in every build.
+  static void CheckPadding(size_t done, size_t bound, const char *what);
+  void Repin(crypto::Key enc_key);
   BlockPointer Find(Key key, BlockPointer root, crypto::Key enc_key);
+  // The number of keys less than k, or not greater than k with or_equal.
+  size_t CountLess(Key k, bool or_equal, crypto::Key enc_key);
+  void Scan(Key lo, Key hi, size_t max_results, BlockPointer root,
+            std::vector<KeyValPair> &res, crypto::Key enc_key);
 };
+
+using OMap = BasicOMap<Key>;
 } // namespace dyno::static_path_omap
 
 #endif //DYNO_STATIC_OMAP_PATH_AVL_H
@@ -0,0 +1,560 @@
+#include "omap.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <string>
+#include <utility>
+
+#include "../../../utils/bytes.h"
+#include "../../../utils/crypto.h"
+#include "../../oram/path/oram.h"
+
+#define max(a, b) ((a)>(b)?(a):(b))
+#define min(a, b) ((a)<(b)?(a):(b))
+
+namespace dyno::static_path_bplus_omap {
+
+namespace {
+// is_leaf_ and the number of keys.
+const size_t kNodeHeaderSize = sizeof(uint8_t) + sizeof(uint32_t);
+
+size_t LeafCapacity(size_t n, size_t val_len) {
+  size_t fit = (kNodeBytes - kNodeHeaderSize) / (sizeof(Key) + val_len);
+  return min(max(2, fit), max(2, n)); // No need for more than n values.
+}
+
+// Upper bound on the number of leaves of a tree with n keys, as every leaf
+// but the root is at least half full.
+size_t MaxLeaves(size_t n, size_t leaf_cap) {
+  size_t min_keys = leaf_cap / 2;
+  return max(1, (n + min_keys - 1) / min_keys);
+}
+
+size_t Fanout(size_t max_leaves) {
+  size_t fit = (kNodeBytes - kNodeHeaderSize + sizeof(Key))
+      / (sizeof(Key) + sizeof(BlockPointer));
+  return min(max(3, fit), max(3, max_leaves));
+}
+
+size_t NodeSize(size_t val_len, size_t leaf_cap, size_t fanout) {
+  return kNodeHeaderSize + max(leaf_cap * (sizeof(Key) + val_len),
+                               ((fanout - 1) * sizeof(Key))
+                                   + (fanout * sizeof(BlockPointer)));
+}
+
+// Max number of levels, leaves included. A tree with h ≥ 2 levels has at
+// least 2 * min_children^(h-2) leaves.
+uint32_t MaxDepth(size_t max_leaves, size_t fanout) {
+  size_t min_children = (fanout + 1) / 2;
+  if (max_leaves < 2)
+    return 1;
+  uint32_t res = 2;
+  for (size_t leaves = 2; leaves * min_children <= max_leaves;
+       leaves *= min_children)
+    ++res;
+  return res;
+}
+
+// Internal nodes are fewer than leaves.
+size_t ORamCapacity(size_t max_leaves) {
+  size_t res = 1;
+  while (res < 2 * max_leaves)
+    res <<= 1;
+  return res;
+}
+} // namespace
+
+Node::Node(const uint8_t *data, size_t val_len) {
+  uint8_t is_leaf;
+  uint32_t num_keys;
+  bytes::FromBytes(data, is_leaf);
+  bytes::FromBytes(data + sizeof(uint8_t), num_keys);
+  is_leaf_ = is_leaf;
+  size_t offset = kNodeHeaderSize;
+  keys_.resize(num_keys);
+  for (auto &k : keys_) {
+    bytes::FromBytes(data + offset, k);
+    offset += sizeof(Key);
+  }
+  if (is_leaf_) {
+    vals_.resize(num_keys);
+    for (auto &v : vals_) {
+      v = std::make_unique<uint8_t[]>(val_len);
+      std::copy_n(data + offset, val_len, v.get());
+      offset += val_len;
+    }
+    return;
+  }
+  children_.resize(num_keys + 1);
+  for (auto &c : children_) {
+    bytes::FromBytes(data + offset, c);
+    offset += sizeof(BlockPointer);
+  }
+}
+
+ORVal Node::ToBytes(size_t val_len, size_t node_size) {
+  ORVal res = std::make_unique<uint8_t[]>(node_size);
+  auto out = res.get();
+  out[0] = is_leaf_;
+  auto num_keys = bytes::ToBytes(static_cast<uint32_t>(keys_.size()));
+  std::copy(num_keys.begin(), num_keys.end(), out + sizeof(uint8_t));
+  size_t offset = kNodeHeaderSize;
+  for (auto k : keys_) {
+    auto kb = bytes::ToBytes(k);
+    std::copy(kb.begin(), kb.end(), out + offset);
+    offset += sizeof(Key);
+  }
+  if (is_leaf_) {
+    for (auto &v : vals_) {
+      if (v) // Else left zero-filled.
+        std::copy_n(v.get(), val_len, out + offset);
+      offset += val_len;
+    }
+  } else {
+    for (auto &c : children_) {
+      auto cb = bytes::ToBytes(c);
+      std::copy(cb.begin(), cb.end(), out + offset);
+      offset += sizeof(BlockPointer);
+    }
+  }
+  assert(offset <= node_size);
+  return std::move(res);
+}
+
+OMap::OMap(size_t n, size_t val_len, const std::string &path,
+           uint8_t max_levels_in_mem, Options opts)
+    : capacity_(n),
+      val_len_(val_len),
+      leaf_cap_(LeafCapacity(n, val_len)),
+      max_leaves_(MaxLeaves(n, leaf_cap_)),
+      fanout_(Fanout(max_leaves_)),
+      node_size_(NodeSize(val_len, leaf_cap_, fanout_)),
+      max_depth_(MaxDepth(max_leaves_, fanout_)),
+      pad_val_((2 * max_depth_) + 1),
+      opts_(opts),
+      oram_(ORamCapacity(max_leaves_), node_size_, path, max_levels_in_mem,
+            false, true, opts.ORamOptions()) {}
+
+// Splitting m entries into ceil(m / cap) nodes as evenly as possible leaves
+// each node at least half full, so the tree is as valid as one built by
+// inserts. A level is a list of (smallest key, node) pairs.
+OMap::OMap(size_t n, size_t val_len, std::vector<KeyValPair> kvs,
+           crypto::Key enc_key, const std::string &path,
+           uint8_t max_levels_in_mem, Options opts)
+    : OMap(n, val_len, path, max_levels_in_mem, opts) {
+  assert(kvs.size() <= n);
+  for (size_t i = 1; i < kvs.size(); ++i)
+    assert(kvs[i - 1].key_ < kvs[i].key_);
+  size_ = kvs.size();
+  std::vector<static_path_oram::Block> blocks;
+  std::vector<std::pair<Key, BlockPointer>> level;
+  size_t num_nodes = (kvs.size() + leaf_cap_ - 1) / leaf_cap_;
+  for (size_t i = 0; i < num_nodes; ++i) {
+    Node leaf(true);
+    for (size_t j = i * kvs.size() / num_nodes;
+         j < (i + 1) * kvs.size() / num_nodes; ++j) {
+      leaf.keys_.push_back(kvs[j].key_);
+      leaf.vals_.push_back(std::move(kvs[j].val_));
+    }
+    Key first = leaf.keys_.front();
+    level.emplace_back(first, BuildNode(std::move(leaf), blocks));
+  }
+  while (level.size() > 1) {
+    std::vector<std::pair<Key, BlockPointer>> parents;
+    num_nodes = (level.size() + fanout_ - 1) / fanout_;
+    for (size_t i = 0; i < num_nodes; ++i) {
+      Node node(false);
+      size_t lo = i * level.size() / num_nodes;
+      for (size_t j = lo; j < (i + 1) * level.size() / num_nodes; ++j) {
+        if (j > lo)
+          node.keys_.push_back(level[j].first);
+        node.children_.push_back(level[j].second);
+      }
+      parents.emplace_back(level[lo].first, BuildNode(std::move(node), blocks));
+    }
+    level = std::move(parents);
+  }
+  if (!level.empty())
+    root_ = level.front().second;
+  oram_.BulkLoad(std::move(blocks), enc_key);
+}
+
+void OMap::Insert(Key k, Val v, crypto::Key enc_key) {
+  if (!root_.key_)
+    root_ = NewNode(Node(true));
+  auto split = Insert(k, v, root_, enc_key);
+  if (split.right_.key_) { // The root was split; grow the tree by one level.
+    Node root(false);
+    root.keys_ = {split.sep_};
+    root.children_ = {root_, split.right_};
+    root_ = NewNode(std::move(root));
+  }
+  Finalize(Op::kInsert, enc_key);
+}
+
+Val OMap::ReadAndRemove(Key k, crypto::Key enc_Key) {
+  Val res;
+  if (root_.key_) {
+    Delete(k, root_, enc_Key);
+    Node *root = Fetch(root_, enc_Key);
+    if (root->is_leaf_ && root->keys_.empty()) {
+      FreeNode(root_);
+      root_ = {0, 0};
+    } else if (!root->is_leaf_ && root->children_.size() == 1) {
+      auto child = root->children_.front();
+      FreeNode(root_);
+      root_ = child;
+    }
+  }
+  if (delete_successful_) {
+    --size_;
+    res = std::move(delete_res_);
+    delete_successful_ = false;
+  }
+  Finalize(Op::kDelete, enc_Key);
+  return std::move(res);
+}
+
+Val OMap::Read(Key k, crypto::Key enc_Key) {
+  Val res;
+  BlockPointer bp = root_;
+  while (bp.key_) {
+    Node *node = Fetch(bp, enc_Key);
+    auto i = std::upper_bound(node->keys_.begin(), node->keys_.end(), k)
+        - node->keys_.begin();
+    if (!node->is_leaf_) {
+      bp = node->children_[i];
+      continue;
+    }
+    if (i > 0 && node->keys_[i - 1] == k) { // Found
+      res = std::make_unique<uint8_t[]>(val_len_);
+      if (node->vals_[i - 1])
+        std::copy_n(node->vals_[i - 1].get(), val_len_, res.get());
+    }
+    break;
+  }
+  Finalize(Op::kRead, enc_Key);
+  return std::move(res);
+}
+
+std::vector<KeyValPair> OMap::RangeScan(Key lo, Key hi, size_t max_results,
+                                        crypto::Key enc_key) {
+  std::vector<KeyValPair> res;
+  if (root_.key_ && lo <= hi)
+    Scan(lo, hi, max_results, root_, res, enc_key);
+  Finalize(ScanPadding(max_results), enc_key);
+  return res;
+}
+
+// Visits, left to right, the children that may hold keys in [lo, hi],
+// stopping at max_results.
+void OMap::Scan(Key lo, Key hi, size_t max_results, BlockPointer bp,
+                std::vector<KeyValPair> &res, crypto::Key enc_key) {
+  if (res.size() >= max_results)
+    return;
+  Node *node = Fetch(bp, enc_key);
+  if (node->is_leaf_) {
+    for (size_t i = 0; i < node->keys_.size() && res.size() < max_results;
+         ++i) {
+      if (node->keys_[i] < lo || node->keys_[i] > hi)
+        continue;
+      Val v = std::make_unique<uint8_t[]>(val_len_);
+      if (node->vals_[i])
+        std::copy_n(node->vals_[i].get(), val_len_, v.get());
+      res.emplace_back(node->keys_[i], std::move(v));
+    }
+    return;
+  }
+  for (size_t i = 0; i < node->children_.size(); ++i) {
+    if (i > 0 && node->keys_[i - 1] > hi)
+      break;
+    if (i < node->keys_.size() && node->keys_[i] <= lo)
+      continue;
+    Scan(lo, hi, max_results, node->children_[i], res, enc_key);
+  }
+}
+
+OMap::Split OMap::Insert(Key k, Val &v, BlockPointer bp,
+                         crypto::Key enc_key) {
+  Node *node = Fetch(bp, enc_key);
+  auto it = std::upper_bound(node->keys_.begin(), node->keys_.end(), k);
+  auto i = it - node->keys_.begin();
+
+  if (node->is_leaf_) {
+    if (i > 0 && node->keys_[i - 1] == k) {
+      node->vals_[i - 1] = std::move(v);
+      return {};
+    }
+    node->keys_.insert(it, k);
+    node->vals_.insert(node->vals_.begin() + i, std::move(v));
+    ++size_;
+    if (node->keys_.size() <= leaf_cap_)
+      return {};
+
+    // Split the leaf; the separator is a copy of the right half's first key.
+    auto mid = node->keys_.size() / 2;
+    Node right(true);
+    right.keys_.assign(node->keys_.begin() + mid, node->keys_.end());
+    right.vals_.assign(std::make_move_iterator(node->vals_.begin() + mid),
+                       std::make_move_iterator(node->vals_.end()));
+    node->keys_.resize(mid);
+    node->vals_.resize(mid);
+    Key sep = right.keys_.front();
+    return {sep, NewNode(std::move(right))};
+  }
+
+  auto split = Insert(k, v, node->children_[i], enc_key);
+  if (!split.right_.key_)
+    return {};
+  node->keys_.insert(node->keys_.begin() + i, split.sep_);
+  node->children_.insert(node->children_.begin() + i + 1, split.right_);
+  if (node->children_.size() <= fanout_)
+    return {};
+
+  // Split the internal node; the middle key moves up to the parent.
+  auto mid = node->keys_.size() / 2;
+  Node right(false);
+  Key sep = node->keys_[mid];
+  right.keys_.assign(node->keys_.begin() + mid + 1, node->keys_.end());
+  right.children_.assign(node->children_.begin() + mid + 1,
+                         node->children_.end());
+  node->keys_.resize(mid);
+  node->children_.resize(mid + 1);
+  return {sep, NewNode(std::move(right))};
+}
+
+// Returns whether the subtree's root underflows.
+bool OMap::Delete(Key k, BlockPointer bp, crypto::Key enc_key) {
+  Node *node = Fetch(bp, enc_key);
+  auto i = std::upper_bound(node->keys_.begin(), node->keys_.end(), k)
+      - node->keys_.begin();
+
+  if (node->is_leaf_) {
+    if (i == 0 || node->keys_[i - 1] != k) // Not found
+      return false;
+    delete_res_ = std::move(node->vals_[i - 1]);
+    delete_successful_ = true;
+    node->keys_.erase(node->keys_.begin() + i - 1);
+    node->vals_.erase(node->vals_.begin() + i - 1);
+    return Underflows(*node);
+  }
+
+  if (!Delete(k, node->children_[i], enc_key))
+    return false;
+  FixChild(*node, i, enc_key);
+  return Underflows(*node);
+}
+
+// Child i of parent underflows: borrow one entry from a sibling, or merge
+// with it when the sibling is at its minimum.
+void OMap::FixChild(Node &parent, size_t i, crypto::Key enc_key) {
+  size_t l = i > 0 ? i - 1 : i; // Index of the left one of the pair.
+  Node *left = Fetch(parent.children_[l], enc_key);
+  Node *right = Fetch(parent.children_[l + 1], enc_key);
+  bool child_is_left = l == i;
+
+  if (CanLend(child_is_left ? *right : *left)) {
+    if (child_is_left && left->is_leaf_) {
+      left->keys_.push_back(right->keys_.front());
+      left->vals_.push_back(std::move(right->vals_.front()));
+      right->keys_.erase(right->keys_.begin());
+      right->vals_.erase(right->vals_.begin());
+      parent.keys_[l] = right->keys_.front();
+    } else if (child_is_left) {
+      left->keys_.push_back(parent.keys_[l]);
+      left->children_.push_back(right->children_.front());
+      parent.keys_[l] = right->keys_.front();
+      right->keys_.erase(right->keys_.begin());
+      right->children_.erase(right->children_.begin());
+    } else if (left->is_leaf_) {
+      right->keys_.insert(right->keys_.begin(), left->keys_.back());
+      right->vals_.insert(right->vals_.begin(), std::move(left->vals_.back()));
+      left->keys_.pop_back();
+      left->vals_.pop_back();
+      parent.keys_[l] = right->keys_.front();
+    } else {
+      right->keys_.insert(right->keys_.begin(), parent.keys_[l]);
+      right->children_.insert(right->children_.begin(),
+                              left->children_.back());
+      parent.keys_[l] = left->keys_.back();
+      left->keys_.pop_back();
+      left->children_.pop_back();
+    }
+    return;
+  }
+
+  // Merge right into left.
+  if (!left->is_leaf_)
+    left->keys_.push_back(parent.keys_[l]);
+  left->keys_.insert(left->keys_.end(),
+                     right->keys_.begin(), right->keys_.end());
+  std::move(right->vals_.begin(), right->vals_.end(),
+            std::back_inserter(left->vals_));
+  left->children_.insert(left->children_.end(),
+                         right->children_.begin(), right->children_.end());
+  FreeNode(parent.children_[l + 1]);
+  parent.keys_.erase(parent.keys_.begin() + l);
+  parent.children_.erase(parent.children_.begin() + l + 1);
+}
+
+bool OMap::Underflows(const Node &node) const {
+  if (node.is_leaf_)
+    return node.keys_.size() < MinKeys();
+  return node.children_.size() < MinChildren();
+}
+
+bool OMap::CanLend(const Node &node) const {
+  if (node.is_leaf_)
+    return node.keys_.size() > MinKeys();
+  return node.children_.size() > MinChildren();
+}
+
+BlockPointer OMap::NewNode(Node node) {
+  ORKey key = oram_.NextKey();
+  cache_[key] = std::move(node);
+  return {key, 0};
+}
+
+BlockPointer OMap::BuildNode(Node node,
+                             std::vector<static_path_oram::Block> &blocks) {
+  BlockPointer res(oram_.NextKey(), oram_.GeneratePos());
+  blocks.emplace_back(res.pos_, res.key_, node.ToBytes(val_len_, node_size_));
+  return res;
+}
+
+void OMap::FreeNode(BlockPointer bp) {
+  cache_.erase(bp.key_);
+  oram_.AddFreedKey(bp.key_);
+}
+
+Node *OMap::Fetch(BlockPointer bp, crypto::Key enc_key) {
+  assert(bp.key_);
+  if (cache_.find(bp.key_) != cache_.end()) // Found in cache
+    return &cache_[bp.key_];
+
+  assert(bp.pos_);
+  ++accesses_before_finalize_;
+  auto orb = oram_.ReadAndRemove(bp.pos_, bp.key_, enc_key);
+  cache_[bp.key_] = Node(orb.val_.get(), val_len_);
+  return &cache_[bp.key_];
+}
+
+// A lookup reads and writes back one root-to-leaf path. An insert reads a
+// path, and writes it back with up to one new node per level and a new root.
+// A delete reads a path and one sibling per level, and writes back at most as
+// many nodes.
+OMap::Padding OMap::PaddingFor(Op op) const {
+  if (!opts_.pad_per_op_)
+    return {pad_val_, pad_val_};
+  switch (op) {
+    case Op::kRead:
+      return {max_depth_, max_depth_};
+    case Op::kInsert:
+      return {max_depth_, pad_val_};
+    default:
+      return {(2 * max_depth_) - 1, (2 * max_depth_) - 1};
+  }
+}
+
+// Apart from the paths to lo and to the last result, a scan only reads whole
+// subtrees of results. Those have at least MinKeys() results per leaf, and
+// fewer internal nodes than leaves.
+OMap::Padding OMap::ScanPadding(size_t max_results) const {
+  size_t leaves = min(max_results, capacity_) / MinKeys();
+  uint32_t bound = min((2 * max_depth_) + (2 * leaves), oram_.Capacity());
+  return {bound, bound};
+}
+
+void OMap::Finalize(Op op, crypto::Key enc_key) {
+  Finalize(PaddingFor(op), enc_key);
+}
+
+void OMap::Finalize(Padding padding, crypto::Key enc_key) {
+  CheckPadding(accesses_before_finalize_, padding.reads_, "reads");
+  // Pad reads
+  for (unsigned int i = accesses_before_finalize_; i < padding.reads_; ++i)
+    oram_.DummyAccess(enc_key);
+  accesses_before_finalize_ = 0;
+
+  // Re-position all cached and write them back with one batched eviction
+  std::map<ORKey, ORPos> pos_map;
+  for (auto &c : cache_)
+    pos_map[c.first] = oram_.GeneratePos();
+
+  if (pos_map.find(root_.key_) != pos_map.end())
+    root_.pos_ = pos_map[root_.key_];
+
+  std::vector<static_path_oram::Block> blocks;
+  blocks.reserve(cache_.size());
+  for (auto &c : cache_) {
+    auto &node = c.second;
+    for (auto &child : node.children_)
+      if (pos_map.find(child.key_) != pos_map.end())
+        child.pos_ = pos_map[child.key_];
+    auto ov = node.ToBytes(val_len_, node_size_);
+    blocks.emplace_back(pos_map[c.first], c.first, std::move(ov));
+  }
+  cache_.clear();
+
+  // Pad writes
+  CheckPadding(blocks.size(), padding.writes_, "writes");
+  oram_.InsertBatch(std::move(blocks), padding.writes_, enc_key);
+}
+
+// Going past the padding would show in the number of accesses, so it is a
+// bug even in release builds.
+void OMap::CheckPadding(size_t done, size_t bound, const char *what) {
+  if (done <= bound)
+    return;
+  std::cerr << "OMap operation made " << done << " " << what
+            << ", over its padding of " << bound << "." << std::endl;
+  std::abort();
+}
+
+KeyValPair OMap::TakeOne(crypto::Key enc_key) {
+  if (!root_.key_) {
+    Finalize(Op::kDelete, enc_key);
+    return {0, nullptr};
+  }
+  Node *node = Fetch(root_, enc_key);
+  while (!node->is_leaf_)
+    node = Fetch(node->children_.front(), enc_key);
+  auto key = node->keys_.front();
+  auto val = ReadAndRemove(key, enc_key);
+  return {key, std::move(val)};
+}
+
+std::vector<KeyValPair> OMap::TakeAll(crypto::Key enc_key) {
+  std::vector<KeyValPair> res;
+  res.reserve(size_);
+  for (auto &b : oram_.TakeAll(enc_key)) {
+    Node node(b.val_.get(), val_len_);
+    if (!node.is_leaf_)
+      continue;
+    for (size_t i = 0; i < node.keys_.size(); ++i)
+      res.emplace_back(node.keys_[i], std::move(node.vals_[i]));
+  }
+  std::sort(res.begin(), res.end(),
+            [](const KeyValPair &a, const KeyValPair &b) {
+              return a.key_ < b.key_;
+            });
+  root_ = {0, 0};
+  size_ = 0;
+  return res;
+}
+
+void OMap::Dummy(Op op, crypto::Key enc_key) {
+  Finalize(op, enc_key);
+}
+
+// Should only be called after allocation.
+void OMap::FillWithDummies(crypto::Key enc_key) {
+  oram_.FillWithDummies(enc_key);
+}
+} // namespace dyno::static_path_bplus_omap
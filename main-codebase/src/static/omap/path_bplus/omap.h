@@ -0,0 +1,145 @@
+#ifndef DYNO_STATIC_OMAP_PATH_BPLUS_H
+#define DYNO_STATIC_OMAP_PATH_BPLUS_H
+
+#include <cstdint>
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "../../../utils/crypto.h"
+#include "../../oram/path/oram.h"
+#include "../path_avl/omap.h"
+
+namespace dyno::static_path_bplus_omap {
+
+using Key = static_path_omap::Key;
+using Val = static_path_omap::Val;
+using KeyValPair = static_path_omap::KeyValPair;
+using BlockPointer = static_path_omap::BlockPointer;
+using Op = static_path_omap::Op;
+using Options = static_path_omap::Options;
+
+using ORKey = static_path_oram::Key;
+using ORPos = static_path_oram::Pos;
+using ORVal = static_path_oram::Val;
+using PathORam = static_path_oram::ORam;
+
+// Nodes are sized to about a page; a node always has room for at least two
+// values, and for at least three children.
+static constexpr const size_t kNodeBytes = 4096;
+
+// One ORAM block. A leaf holds sorted keys and their values; an internal node
+// holds sorted separator keys and one more child than keys, where child i
+// holds the keys in [keys_[i-1], keys_[i]).
+class Node {
+ public:
+  bool is_leaf_ = true;
+  std::vector<Key> keys_;
+  std::vector<Val> vals_; // Leaves only.
+  std::vector<BlockPointer> children_; // Internal nodes only.
+
+  Node() = default;
+  explicit Node(bool is_leaf) : is_leaf_(is_leaf) {}
+  Node(const uint8_t *data, size_t val_len);
+
+  ORVal ToBytes(size_t val_len, size_t node_size);
+};
+
+// Same interface as static_path_omap::OMap, but a B+-tree with one node per
+// ORAM block, so each operation touches O(log_B n) blocks instead of
+// O(log_2 n). By default every operation is padded to pad_val_ ORAM reads and
+// as many writes: at most one node per level plus one sibling per level is
+// read, and at most one new node per level plus a new root is written.
+class OMap {
+ public:
+  using Key = static_path_omap::Key;
+  using KeyValPair = static_path_omap::KeyValPair;
+
+  // PosixSingleFile -- On file store error reverts to RAM store.
+  OMap(size_t n, size_t val_len, const std::string &file_path = "",
+       uint8_t max_levels_in_mem = 0, Options opts = Options());
+  // Bulk build from `kvs`, sorted by strictly increasing keys (at most n of
+  // them): leaves and internal nodes are filled evenly, level by level, and
+  // written with one pass over the ORAM. Replaces FillWithDummies.
+  OMap(size_t n, size_t val_len, std::vector<KeyValPair> kvs,
+       crypto::Key enc_key, const std::string &file_path = "",
+       uint8_t max_levels_in_mem = 0, Options opts = Options());
+  void Insert(Key k, Val v, crypto::Key enc_key);
+  Val Read(Key k, crypto::Key enc_Key);
+  Val ReadAndRemove(Key k, crypto::Key enc_Key);
+  // Up to max_results pairs with keys in [lo, hi], in key order. Padded to a
+  // bound that only depends on max_results, see static_path_omap::OMap.
+  std::vector<KeyValPair> RangeScan(Key lo, Key hi, size_t max_results,
+                                    crypto::Key enc_key);
+  KeyValPair TakeOne(crypto::Key enc_key);
+  // All pairs, in key order, read with one pass over the ORAM. Leaves the map
+  // empty.
+  std::vector<KeyValPair> TakeAll(crypto::Key enc_key);
+  // Looks like an operation of kind `op`, without touching the map.
+  void Dummy(Op op, crypto::Key enc_key);
+  void FillWithDummies(crypto::Key enc_key);
+  [[nodiscard]] size_t Capacity() const { return capacity_; }
+  [[nodiscard]] size_t Size() const { return size_; }
+  [[nodiscard]] uint64_t MemoryAccessCount() const { return oram_.MemoryAccessCount(); }
+  [[nodiscard]] uint64_t MemoryBytesMovedTotal() const { return oram_.MemoryBytesMovedTotal(); }
+  [[nodiscard]] bool IsOnDisk() const { return oram_.IsOnDisk(); }
+
+ private:
+  // Result of inserting into a subtree: if the subtree's root was split, the
+  // new right sibling and the separator to insert in the parent.
+  class Split {
+   public:
+    Key sep_ = 0;
+    BlockPointer right_{0, 0};
+  };
+
+  // Number of ORAM reads and writes an operation is padded to.
+  class Padding {
+   public:
+    uint32_t reads_;
+    uint32_t writes_;
+  };
+
+  const size_t capacity_;
+  const size_t val_len_;
+  const size_t leaf_cap_; // Max values per leaf.
+  const size_t max_leaves_;
+  const size_t fanout_; // Max children per internal node.
+  const size_t node_size_;
+  const uint32_t max_depth_;
+  const uint32_t pad_val_;
+  const Options opts_;
+  size_t size_ = 0;
+  PathORam oram_;
+  BlockPointer root_ = BlockPointer(0, 0); // Can and will change.
+  uint32_t accesses_before_finalize_ = 0;
+  std::map<ORKey, Node> cache_;
+  Val delete_res_;
+  bool delete_successful_ = false;
+
+  [[nodiscard]] size_t MinKeys() const { return leaf_cap_ / 2; }
+  [[nodiscard]] size_t MinChildren() const { return (fanout_ + 1) / 2; }
+  [[nodiscard]] bool Underflows(const Node &node) const;
+  [[nodiscard]] bool CanLend(const Node &node) const;
+  Split Insert(Key k, Val &v, BlockPointer bp, crypto::Key enc_key);
+  bool Delete(Key k, BlockPointer bp, crypto::Key enc_key);
+  void FixChild(Node &parent, size_t i, crypto::Key enc_key);
+  BlockPointer NewNode(Node node);
+  // For the bulk build: gives node a key and position, and adds it to blocks.
+  BlockPointer BuildNode(Node node,
+                         std::vector<static_path_oram::Block> &blocks);
+  void FreeNode(BlockPointer bp);
+  Node *Fetch(BlockPointer bp, crypto::Key enc_key);
+  void Scan(Key lo, Key hi, size_t max_results, BlockPointer bp,
+            std::vector<KeyValPair> &res, crypto::Key enc_key);
+  [[nodiscard]] Padding PaddingFor(Op op) const;
+  [[nodiscard]] Padding ScanPadding(size_t max_results) const;
+  void Finalize(Op op, crypto::Key enc_key);
+  void Finalize(Padding padding, crypto::Key enc_key);
+  // Aborts if done > bound, in every build.
+  static void CheckPadding(size_t done, size_t bound, const char *what);
+};
+} // namespace dyno::static_path_bplus_omap
+
+#endif //DYNO_STATIC_OMAP_PATH_BPLUS_H
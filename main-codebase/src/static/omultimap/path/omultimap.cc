@@ -0,0 +1,203 @@
+#include "omultimap.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../../../utils/bytes.h"
+#include "../../../utils/crypto.h"
+
+namespace dyno::static_path_omultimap {
+
+Directory::Directory(const uint8_t *data, size_t page_len) {
+  bytes::FromBytes(data, count_);
+  data += sizeof(count_);
+  // Page keys are never 0, so a 0 ends the list.
+  for (size_t i = 0; i < MaxPages(page_len); ++i, data += sizeof(ORKey)) {
+    ORKey k;
+    bytes::FromBytes(data, k);
+    if (!k)
+      break;
+    pages_.push_back(k);
+  }
+}
+
+size_t Directory::MaxPages(size_t page_len) {
+  return (page_len - sizeof(uint32_t)) / sizeof(ORKey);
+}
+
+Val Directory::ToBytes(size_t page_len) const {
+  assert(pages_.size() <= MaxPages(page_len));
+  auto res = std::make_unique<uint8_t[]>(page_len);
+  auto count_bytes = bytes::ToBytes(count_);
+  auto out = std::copy(count_bytes.begin(), count_bytes.end(), res.get());
+  for (auto k : pages_) {
+    auto k_bytes = bytes::ToBytes(k);
+    out = std::copy(k_bytes.begin(), k_bytes.end(), out);
+  }
+  return res;
+}
+
+// Each key wastes at most one partly filled page besides its directory.
+static size_t NumBlocks(size_t num_keys, size_t num_vals, size_t per_page) {
+  size_t needed = 2 * num_keys + (num_vals + per_page - 1) / per_page;
+  size_t res = 1;
+  while (res < needed)
+    res <<= 1;
+  return res;
+}
+
+OMultiMap::OMultiMap(size_t num_keys, size_t num_vals, size_t val_len,
+                     size_t page_len, const std::string &file_path,
+                     uint8_t max_levels_in_mem, static_path_omap::Options opts)
+    : val_len_(val_len),
+      page_len_(page_len),
+      vals_per_page_(page_len / val_len),
+      index_(num_keys, sizeof(ORKey), file_path, max_levels_in_mem, opts),
+      pages_(NumBlocks(num_keys, num_vals, std::max<size_t>(1, vals_per_page_)),
+             page_len, file_path.empty() ? "" : file_path + ".pages",
+             max_levels_in_mem, true, true) {
+  assert(vals_per_page_ >= 1);
+  assert(Directory::MaxPages(page_len_) >= 1);
+}
+
+size_t OMultiMap::MaxValsPerKey() const {
+  return vals_per_page_ * Directory::MaxPages(page_len_);
+}
+
+bool OMultiMap::Append(Key k, std::vector<Val> vals, crypto::Key enc_key) {
+  assert(!vals.empty());
+  // A list past MaxValsPerKey would not fit its directory page. A rejected
+  // append still makes the same accesses, but writes back what it read as is.
+  // Since a new list always fits, only this case can reject a missing key, and
+  // it then links no directory.
+  bool too_many = vals.size() > MaxValsPerKey();
+
+  // One insert-padded OMap access either finds the directory or links a new
+  // (still empty) one.
+  ORKey dir_key = 0;
+  if (too_many) {
+    index_.Dummy(static_path_omap::Op::kInsert, enc_key);
+  } else {
+    dir_key = pages_.NextKey();
+    auto dir_key_bytes = bytes::ToBytes(dir_key);
+    auto dir_key_val = std::make_unique<uint8_t[]>(sizeof(ORKey));
+    std::copy(dir_key_bytes.begin(), dir_key_bytes.end(), dir_key_val.get());
+    auto existing = index_.ReadOrInsert(k, std::move(dir_key_val), enc_key);
+    if (existing) {
+      pages_.AddFreedKey(dir_key);
+      bytes::FromBytes(existing.get(), dir_key);
+    }
+  }
+
+  // A new directory is not in the ORAM yet, so this is a dummy access.
+  auto dir_block = pages_.ReadAndRemove(0, dir_key, enc_key);
+  Directory dir;
+  if (dir_block.meta_.key_)
+    dir = Directory(dir_block.val_.get(), page_len_);
+  bool fits = dir.count_ + vals.size() <= MaxValsPerKey();
+
+  // The last page, when partly filled, or a dummy access.
+  size_t used = dir.count_ % vals_per_page_;
+  ORKey page_key = used ? dir.pages_.back() : 0;
+  Val page = std::move(pages_.ReadAndRemove(0, page_key, enc_key).val_);
+
+  std::vector<static_path_oram::Block> blocks;
+  for (auto &v : vals) {
+    if (!fits)
+      break;
+    if (!page) {
+      page = std::make_unique<uint8_t[]>(page_len_);
+      page_key = pages_.NextKey();
+      dir.pages_.push_back(page_key);
+    }
+    std::copy_n(v.get(), val_len_, page.get() + (used * val_len_));
+    ++dir.count_;
+    if (++used == vals_per_page_) {
+      blocks.emplace_back(0, page_key, std::move(page));
+      used = 0;
+    }
+  }
+  if (page)
+    blocks.emplace_back(0, page_key, std::move(page));
+  if (dir_key)
+    blocks.emplace_back(0, dir_key, dir.ToBytes(page_len_));
+
+  // At most one more page than the values fill on their own.
+  size_t num_evictions = 2 + ((vals.size() + vals_per_page_ - 1) / vals_per_page_);
+  pages_.InsertBatch(std::move(blocks), num_evictions, enc_key);
+  return fits;
+}
+
+bool OMultiMap::Append(Key k, Val v, crypto::Key enc_key) {
+  std::vector<Val> vals;
+  vals.push_back(std::move(v));
+  return Append(k, std::move(vals), enc_key);
+}
+
+std::vector<Val> OMultiMap::ReadPage(Key k, size_t i, crypto::Key enc_key) {
+  auto dir = ReadDirectory(DirectoryKey(k, enc_key), enc_key);
+  ORKey page_key = i < dir.pages_.size() ? dir.pages_[i] : 0;
+  auto page = pages_.Read(0, page_key, enc_key);
+  std::vector<Val> res;
+  if (page_key) {
+    size_t n = std::min(vals_per_page_, dir.count_ - (i * vals_per_page_));
+    AppendPage(page.val_, n, n, res);
+  }
+  return res;
+}
+
+std::vector<Val> OMultiMap::ReadAll(Key k, size_t max_vals,
+                                    crypto::Key enc_key) {
+  assert(max_vals <= MaxValsPerKey());
+  auto dir = ReadDirectory(DirectoryKey(k, enc_key), enc_key);
+  size_t num_pages = (max_vals + vals_per_page_ - 1) / vals_per_page_;
+  std::vector<Val> res;
+  for (size_t i = 0; i < num_pages; ++i) {
+    ORKey page_key = i < dir.pages_.size() ? dir.pages_[i] : 0;
+    auto page = pages_.Read(0, page_key, enc_key);
+    if (page_key) {
+      size_t n = std::min(vals_per_page_, dir.count_ - (i * vals_per_page_));
+      AppendPage(page.val_, n, max_vals, res);
+    }
+  }
+  return res;
+}
+
+uint64_t OMultiMap::MemoryAccessCount() const {
+  return index_.MemoryAccessCount() + pages_.MemoryAccessCount();
+}
+
+uint64_t OMultiMap::MemoryBytesMovedTotal() const {
+  return index_.MemoryBytesMovedTotal() + pages_.MemoryBytesMovedTotal();
+}
+
+ORKey OMultiMap::DirectoryKey(Key k, crypto::Key enc_key) {
+  auto v = index_.Read(k, enc_key);
+  ORKey res = 0;
+  if (v)
+    bytes::FromBytes(v.get(), res);
+  return res;
+}
+
+Directory OMultiMap::ReadDirectory(ORKey dir_key, crypto::Key enc_key) {
+  auto b = pages_.Read(0, dir_key, enc_key);
+  if (!b.meta_.key_)
+    return {};
+  return {b.val_.get(), page_len_};
+}
+
+void OMultiMap::AppendPage(const Val &data, size_t num_vals, size_t max_vals,
+                           std::vector<Val> &res) const {
+  for (size_t j = 0; j < num_vals && res.size() < max_vals; ++j) {
+    auto v = std::make_unique<uint8_t[]>(val_len_);
+    std::copy_n(data.get() + (j * val_len_), val_len_, v.get());
+    res.push_back(std::move(v));
+  }
+}
+} // namespace dyno::static_path_omultimap
@@ -0,0 +1,86 @@
+#ifndef DYNO_STATIC_OMULTIMAP_PATH_OMULTIMAP_H_
+#define DYNO_STATIC_OMULTIMAP_PATH_OMULTIMAP_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "../../../utils/crypto.h"
+#include "../../omap/path_avl/omap.h"
+#include "../../oram/path/oram.h"
+
+namespace dyno::static_path_omultimap {
+
+using Key = static_path_omap::Key;
+using Val = static_path_omap::Val;
+
+using ORKey = static_path_oram::Key;
+using PathORam = static_path_oram::ORam;
+
+// The page list of a key, one block of the page ORAM: the number of values,
+// then the keys of the pages holding them, in order.
+class Directory {
+ public:
+  uint32_t count_ = 0;
+  std::vector<ORKey> pages_;
+
+  Directory() = default;
+  Directory(const uint8_t *data, size_t page_len);
+
+  [[nodiscard]] static size_t MaxPages(size_t page_len);
+  Val ToBytes(size_t page_len) const;
+};
+
+// A map from a key to a list of values. The values of a key are packed into
+// fixed-size pages of a Path ORAM, and a directory block in the same ORAM
+// lists the key's pages; an OMap only maps the key to its directory. So an
+// Append of m values is one OMap operation and a batch write of the touched
+// pages, not m tree inserts.
+//
+// Accesses are padded to a count that only depends on the number of values
+// appended, or asked for; the length of a key's list is hidden up to that.
+class OMultiMap {
+ public:
+  // Pages hold page_len / val_len values each. num_keys and num_vals bound the
+  // distinct keys and the values over all keys. PosixSingleFile for both the
+  // index and the pages (at file_path + ".pages") -- On file store error
+  // reverts to RAM store.
+  OMultiMap(size_t num_keys, size_t num_vals, size_t val_len, size_t page_len,
+            const std::string &file_path = "", uint8_t max_levels_in_mem = 0,
+            static_path_omap::Options opts = static_path_omap::Options());
+  // Appends vals to the list of k. Padded to one OMap insert, two page reads
+  // and a batch write of 2 + ceil(|vals| / ValsPerPage()) blocks. Returns
+  // false, and leaves the list as it was, if it would exceed MaxValsPerKey.
+  bool Append(Key k, std::vector<Val> vals, crypto::Key enc_key);
+  bool Append(Key k, Val v, crypto::Key enc_key);
+  // The values on the i-th page of k's list; empty past its end.
+  std::vector<Val> ReadPage(Key k, size_t i, crypto::Key enc_key);
+  // Up to max_vals values of k's list, in order. Always reads
+  // ceil(max_vals / ValsPerPage()) pages.
+  std::vector<Val> ReadAll(Key k, size_t max_vals, crypto::Key enc_key);
+  [[nodiscard]] size_t ValsPerPage() const { return vals_per_page_; }
+  [[nodiscard]] size_t MaxValsPerKey() const;
+  [[nodiscard]] size_t NumKeys() const { return index_.Size(); }
+  [[nodiscard]] uint64_t MemoryAccessCount() const;
+  [[nodiscard]] uint64_t MemoryBytesMovedTotal() const;
+  [[nodiscard]] bool IsOnDisk() const { return pages_.IsOnDisk(); }
+
+ private:
+  const size_t val_len_;
+  const size_t page_len_;
+  const size_t vals_per_page_;
+  static_path_omap::OMap index_; // Key -> ORKey of its directory.
+  PathORam pages_;
+
+  // The directory key of k, 0 when missing.
+  ORKey DirectoryKey(Key k, crypto::Key enc_key);
+  // Reads a directory (a dummy read for key 0); empty when missing.
+  Directory ReadDirectory(ORKey dir_key, crypto::Key enc_key);
+  // Appends the values of page `data` (if any) to res, up to max_vals.
+  void AppendPage(const Val &data, size_t num_vals, size_t max_vals,
+                  std::vector<Val> &res) const;
+};
+} // namespace dyno::static_path_omultimap
+
+#endif //DYNO_STATIC_OMULTIMAP_PATH_OMULTIMAP_H_
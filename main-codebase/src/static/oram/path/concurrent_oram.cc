@@ -0,0 +1,139 @@
+#include "concurrent_oram.h"
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "oram.h"
+#include "../../../utils/crypto.h"
+
+namespace dyno::static_path_oram {
+
+ConcurrentORam::ConcurrentORam(size_t n, size_t val_len,
+                               const std::string &file_path,
+                               uint8_t max_levels_in_mem, size_t max_batch,
+                               unsigned num_threads)
+    : val_len_(val_len),
+      max_batch_(max_batch),
+      oram_(n, val_len, file_path, max_levels_in_mem, true),
+      pool_(num_threads) {
+  assert(max_batch_ > 0);
+  sequencer_ = std::thread(&ConcurrentORam::SequencerLoop, this);
+}
+
+ConcurrentORam::~ConcurrentORam() {
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  sequencer_.join();
+}
+
+std::future<Block> ConcurrentORam::Read(Key k, crypto::Key enc_key) {
+  Request req{Op::kRead, k, nullptr, enc_key};
+  auto res = req.read_res_.get_future();
+  Submit(std::move(req));
+  return res;
+}
+
+std::future<Block> ConcurrentORam::ReadAndRemove(Key k, crypto::Key enc_key) {
+  Request req{Op::kReadAndRemove, k, nullptr, enc_key};
+  auto res = req.read_res_.get_future();
+  Submit(std::move(req));
+  return res;
+}
+
+std::future<void> ConcurrentORam::Insert(Key k, Val v, crypto::Key enc_key) {
+  Request req{Op::kInsert, k, std::move(v), enc_key};
+  auto res = req.insert_res_.get_future();
+  Submit(std::move(req));
+  return res;
+}
+
+void ConcurrentORam::Submit(Request req) {
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    queue_.push_back(std::move(req));
+  }
+  cv_.notify_one();
+}
+
+void ConcurrentORam::SequencerLoop() {
+  std::unique_lock<std::mutex> lock(mu_);
+  while (true) {
+    cv_.wait(lock, [&] { return stop_ || !queue_.empty(); });
+    if (queue_.empty())
+      return; // Stopped, and nothing left to serve.
+
+    // A batch shares one encryption key.
+    std::deque<Request> batch;
+    auto enc_key = queue_.front().enc_key_;
+    while (!queue_.empty() && batch.size() < max_batch_
+        && queue_.front().enc_key_ == enc_key) {
+      batch.push_back(std::move(queue_.front()));
+      queue_.pop_front();
+    }
+    lock.unlock();
+    ServeBatch(batch);
+    lock.lock();
+  }
+}
+
+void ConcurrentORam::ServeBatch(std::deque<Request> &batch) {
+  std::vector<Key> keys;
+  std::map<Key, unsigned int> key_idx;
+  for (auto &req : batch) {
+    if (key_idx.find(req.key_) == key_idx.end()) {
+      key_idx[req.key_] = keys.size();
+      keys.push_back(req.key_);
+    }
+  }
+
+  std::vector<Block> read_res(batch.size());
+  auto update = [&](std::vector<Block> current) {
+    for (unsigned int i = 0; i < batch.size(); ++i) {
+      auto &req = batch[i];
+      auto &cur = current[key_idx[req.key_]];
+      switch (req.op_) {
+        case Op::kRead:
+          read_res[i] = Block(cur, val_len_);
+          break;
+        case Op::kReadAndRemove:
+          read_res[i] = std::move(cur);
+          cur = Block(true);
+          break;
+        case Op::kInsert:
+          cur = Block(0, req.key_, std::move(req.val_));
+          break;
+      }
+    }
+
+    std::vector<Block> write_back;
+    for (auto &b : current)
+      if (b.meta_.key_)
+        write_back.push_back(std::move(b));
+    return write_back;
+  };
+  oram_.UpdateBatch(keys, batch.size(), update,
+                    batch.front().enc_key_, &pool_);
+
+  for (unsigned int i = 0; i < batch.size(); ++i) {
+    if (batch[i].op_ == Op::kInsert) {
+      batch[i].insert_res_.set_value();
+    } else {
+      read_res[i].meta_.pos_ = 0;
+      batch[i].read_res_.set_value(std::move(read_res[i]));
+    }
+  }
+}
+
+} // namespace dyno::static_path_oram
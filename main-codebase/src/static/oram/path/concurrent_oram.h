@@ -0,0 +1,79 @@
+#ifndef DYNO_STATIC_ORAM_PATH_CONCURRENT_ORAM_H
+#define DYNO_STATIC_ORAM_PATH_CONCURRENT_ORAM_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "oram.h"
+#include "../../../utils/crypto.h"
+#include "../../../utils/thread_pool.h"
+
+namespace dyno::static_path_oram {
+
+// A front-end that lets many client threads use one PathORAM at the same time
+// (in the spirit of TaoStore). Requests are queued, and a sequencer thread
+// serves them in batches of up to `max_batch`:
+//  - All requests of a batch on the same key are served, in arrival order,
+//    from a single fetch of the block; later requests see earlier writes.
+//  - The paths of a batch are fetched together, so buckets shared by several
+//    paths (the upper levels of the tree) are read and written back once.
+//  - Bucket decryption and encryption run on `num_threads` threads.
+// A batch of r requests always touches r paths, whatever the keys are.
+class ConcurrentORam {
+ public:
+  // PosixSingleFile -- On file store error reverts to RAM store.
+  ConcurrentORam(size_t n, size_t val_len, const std::string &file_path = "",
+                 uint8_t max_levels_in_mem = 0, size_t max_batch = 16,
+                 unsigned num_threads = 4);
+  ~ConcurrentORam();
+
+  // Resolve to a zero-filled block if the key isn't found.
+  std::future<Block> Read(Key k, crypto::Key enc_key);
+  std::future<Block> ReadAndRemove(Key k, crypto::Key enc_key);
+  std::future<void> Insert(Key k, Val v, crypto::Key enc_key);
+
+  // The counters are only consistent while no requests are in flight.
+  [[nodiscard]] size_t Capacity() const { return oram_.Capacity(); }
+  [[nodiscard]] size_t Size() const { return oram_.Size(); }
+  [[nodiscard]] uint64_t MemoryAccessCount() const { return oram_.MemoryAccessCount(); }
+  [[nodiscard]] uint64_t MemoryBytesMovedTotal() const { return oram_.MemoryBytesMovedTotal(); }
+  [[nodiscard]] bool IsOnDisk() const { return oram_.IsOnDisk(); }
+
+ private:
+  enum class Op { kRead, kReadAndRemove, kInsert };
+
+  class Request {
+   public:
+    Op op_;
+    Key key_;
+    Val val_;
+    crypto::Key enc_key_;
+    std::promise<Block> read_res_{};
+    std::promise<void> insert_res_{};
+  };
+
+  const size_t val_len_;
+  const size_t max_batch_;
+  ORam oram_;
+  utils::ThreadPool pool_;
+  std::mutex mu_;
+  std::condition_variable cv_;
+  std::deque<Request> queue_;
+  bool stop_ = false;
+  std::thread sequencer_;
+
+  void Submit(Request req);
+  void SequencerLoop();
+  void ServeBatch(std::deque<Request> &batch);
+};
+
+} // namespace dyno::static_path_oram
+
+#endif //DYNO_STATIC_ORAM_PATH_CONCURRENT_ORAM_H
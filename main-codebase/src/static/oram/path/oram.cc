@@ -5,15 +5,20 @@
 #include <array>
 #include <cassert>
 #include <cmath>
+#include <functional>
 #include <iostream>
+#include <iterator>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 #include "openssl/rand.h"
 
 #include "../../../utils/bytes.h"
 #include "../../../utils/crypto.h"
+#include "../../../utils/heap_index.h"
 #include "../../../store/hybrid_store.h"
 #include "../../../store/posix_single_file_store.h"
 #include "../../../store/ram_store.h"
@@ -35,7 +40,7 @@ Block::Block(const Block &b, const size_t val_len) : meta_(b.meta_) {
   if (!b.val_)
     return;
   val_ = std::make_unique<uint8_t[]>(val_len);
-  std::copy_n(b.val_.get() + sizeof(BlockMetadata), val_len, val_.get());
+  std::copy_n(b.val_.get(), val_len, val_.get());
 }
 
 void Block::ToBytes(size_t val_len, uint8_t *out) {
@@ -46,58 +51,83 @@ void Block::ToBytes(size_t val_len, uint8_t *out) {
     std::copy(val_.get(), val_.get() + val_len, out + sizeof(BlockMetadata));
 }
 
-Bucket::Bucket(uint8_t *data, size_t val_len) {
+Bucket::Bucket(uint8_t *data, size_t val_len, unsigned int z) {
   bytes::FromBytes(data, meta_);
   size_t offset = sizeof(BucketMetadata);
-  for (int i = 0; i < kBucketSize; ++i) {
+  for (unsigned int i = 0; i < z; ++i) {
     blocks_[i] = Block(data + offset, val_len);
     offset += BlockSize(val_len);
   }
 }
 
-std::unique_ptr<uint8_t[]> Bucket::ToBytes(size_t val_len) {
-  auto res = std::make_unique<uint8_t[]>(BucketSize(val_len));
-  ToBytes(res.get(), val_len);
+std::unique_ptr<uint8_t[]> Bucket::ToBytes(size_t val_len, unsigned int z) {
+  auto res = std::make_unique<uint8_t[]>(BucketSize(val_len, z));
+  ToBytes(res.get(), val_len, z);
   return std::move(res);
 }
 
-void Bucket::ToBytes(uint8_t *res, size_t val_len) {
+void Bucket::ToBytes(uint8_t *res, size_t val_len, unsigned int z) {
   const auto meta_f = reinterpret_cast<const uint8_t *> (std::addressof(meta_));
   size_t offset = sizeof(BucketMetadata);
   const auto meta_l = meta_f + offset;
   std::copy(meta_f, meta_l, res);
-  for (int i = 0; i < kBucketSize; ++i) {
+  for (unsigned int i = 0; i < z; ++i) {
     blocks_[i].ToBytes(val_len, res + offset);
     offset += BlockSize(val_len);
   }
 }
 
 ORam::ORam(size_t n, size_t val_len,
-           bool with_pos_map, bool with_key_gen)
+           bool with_pos_map, bool with_key_gen, Options opts)
     : capacity_(n),
       num_buckets_(max(1, n - 1)),
       val_len_(val_len),
-      store_(std::make_unique<store::RamStore>(
-          num_buckets_, EncryptedBucketSize(val_len_))),
+      store_(opts.store_pool_ ? nullptr : std::make_unique<store::RamStore>(
+          num_buckets_, StoredBucketSize(val_len_, opts))),
       depth_(max(0, ceil(log2(n)) - 1)),
       with_pos_map_(with_pos_map),
       with_key_gen_(with_key_gen),
-      bucket_buffer_(std::make_unique<uint8_t[]>(BucketSize(val_len))),
-      enc_bucket_buffer_(std::make_unique<uint8_t[]>(EncryptedBucketSize(val_len))) {}
+      bucket_buffer_(std::make_unique<uint8_t[]>(
+          BucketSize(val_len, opts.bucket_size_))),
+      enc_bucket_buffer_(std::make_unique<uint8_t[]>(
+          StoredBucketSize(val_len, opts))),
+      opts_(opts),
+      zero_val_(std::make_unique<uint8_t[]>(val_len)) {
+  assert(0 < opts_.bucket_size_ && opts_.bucket_size_ <= kBucketSize);
+  if (opts_.store_pool_)
+    store_ = opts_.store_pool_->Acquire(num_buckets_, EncryptedBucketLen(),
+                                        &is_on_disk_);
+  if (opts_.async_evict_)
+    evictor_ = std::thread(&ORam::EvictLoop, this);
+}
 
 ORam::ORam(size_t n, size_t val_len, const std::string &path,
-           uint8_t max_levels_in_mem, bool with_pos_map, bool with_key_gen)
+           uint8_t max_levels_in_mem, bool with_pos_map, bool with_key_gen,
+           Options opts)
     : capacity_(n),
       num_buckets_(max(1, n - 1)),
       val_len_(val_len),
       depth_(max(0, ceil(log2(n)) - 1)),
       with_pos_map_(with_pos_map),
       with_key_gen_(with_key_gen),
-      bucket_buffer_(std::make_unique<uint8_t[]>(BucketSize(val_len))),
-      enc_bucket_buffer_(std::make_unique<uint8_t[]>(EncryptedBucketSize(val_len))) {
+      bucket_buffer_(std::make_unique<uint8_t[]>(
+          BucketSize(val_len, opts.bucket_size_))),
+      enc_bucket_buffer_(std::make_unique<uint8_t[]>(
+          StoredBucketSize(val_len, opts))),
+      opts_(opts),
+      zero_val_(std::make_unique<uint8_t[]>(val_len)) {
+  assert(0 < opts_.bucket_size_ && opts_.bucket_size_ <= kBucketSize);
+  if (opts_.async_evict_)
+    evictor_ = std::thread(&ORam::EvictLoop, this);
+
+  if (opts_.store_pool_) {
+    store_ = opts_.store_pool_->Acquire(num_buckets_, EncryptedBucketLen(),
+                                        &is_on_disk_);
+    return;
+  }
   if (path.empty() || max_levels_in_mem >= depth_) {
     store_ = std::make_unique<store::RamStore>(
-        num_buckets_, EncryptedBucketSize(val_len_));
+        num_buckets_, EncryptedBucketLen());
     return;
   }
 
@@ -105,11 +135,11 @@ ORam::ORam(size_t n, size_t val_len, const std::string &path,
   size_t disk_buckets = num_buckets_ - mem_buckets;
 
   auto disk_store = store::PosixSingleFileStore::Construct(
-      disk_buckets, EncryptedBucketSize(val_len_), path, true);
+      disk_buckets, EncryptedBucketLen(), path, true);
   if (!disk_store) {
     std::cerr << "Failed to create file store." << std::endl;
     store_ = std::make_unique<store::RamStore>(
-        num_buckets_, EncryptedBucketSize(val_len_));
+        num_buckets_, EncryptedBucketLen());
     return;
   }
 
@@ -120,7 +150,7 @@ ORam::ORam(size_t n, size_t val_len, const std::string &path,
   }
 
   auto mem_store = std::make_unique<store::RamStore>(
-      mem_buckets, EncryptedBucketSize(val_len_));
+      mem_buckets, EncryptedBucketLen());
 
   std::vector<std::unique_ptr<store::Store>> s;
   s.push_back(std::move(mem_store));
@@ -129,6 +159,19 @@ ORam::ORam(size_t n, size_t val_len, const std::string &path,
       new store::HybridStore(std::move(s), {mem_buckets, num_buckets_}));
 }
 
+ORam::~ORam() {
+  if (evictor_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      stop_evictor_ = true;
+    }
+    cv_.notify_all();
+    evictor_.join();
+  }
+  if (opts_.store_pool_)
+    opts_.store_pool_->Release(std::move(store_));
+}
+
 Block ORam::ReadAndRemove(Pos p, Key k, crypto::Key enc_key) {
   if (with_pos_map_) {
     if (pos_map_.find(k) != pos_map_.end()) {
@@ -141,18 +184,15 @@ Block ORam::ReadAndRemove(Pos p, Key k, crypto::Key enc_key) {
     }
   }
 
-  Block res = ReadPath(p, k, enc_key);
-  Evict(p, enc_key);
-  auto it = stash_.begin();
-  while (it < stash_.end()) {
-    if (it->meta_.key_ == k && it->meta_.pos_ == p)
-      break;
-    ++it;
-  }
-  if (it != stash_.end()) {
-    res = std::move(*it);
-    stash_.erase(it);
+  auto valid = NewBucketValidity();
+  Block res = ReadPath(p, k, enc_key, valid);
+  if (!res.meta_.key_) { // The requested block may be in stash.
+    std::lock_guard<std::mutex> lock(mu_);
+    res = TakeFromStash(p, k);
   }
+  OpenPayload(res, enc_key);
+  IssueEvict(p, enc_key, std::move(valid));
+  EvictExtraPaths(enc_key);
   if (res.meta_.key_)
     --size_;
   return res;
@@ -170,22 +210,25 @@ Block ORam::Read(Pos p, Key k, crypto::Key enc_key) {
     }
   }
 
-  Block res = ReadPath(p, k, enc_key);
+  auto valid = NewBucketValidity();
+  Block res = ReadPath(p, k, enc_key, valid);
 
   auto new_p = GeneratePos();
-  res.meta_.pos_ = new_p;
   if (with_pos_map_)
     pos_map_[k] = new_p;
 
-  if (res.meta_.key_)
-    stash_.emplace_back(res, val_len_);
-  Evict(p, enc_key);
-  for (Block &b : stash_) { // The requested block may be in stash.
-    if (b.meta_.pos_ == p && b.meta_.key_ == k) {
-      b.meta_.pos_ = new_p;
-      res = Block(b, val_len_);
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    if (!res.meta_.key_) { // The requested block may be in stash.
+      res = TakeFromStash(p, k);
+      OpenPayload(res, enc_key);
     }
+    res.meta_.pos_ = new_p;
+    if (res.meta_.key_)
+      stash_.emplace_back(res, val_len_);
   }
+  IssueEvict(p, enc_key, std::move(valid));
+  EvictExtraPaths(enc_key);
   return std::move(res);
 }
 
@@ -198,9 +241,14 @@ void ORam::Insert(Block block, crypto::Key enc_key) {
   // Shouldn't deterministically be the same as block.pos_
   // Can give more control to the caller on what pos to evict.
   auto write_pos = GeneratePos();
-  ReadPath(write_pos, 0, enc_key);
-  stash_.push_back(std::move(block));
-  Evict(write_pos, enc_key);
+  auto valid = NewBucketValidity();
+  ReadPath(write_pos, 0, enc_key, valid);
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    stash_.push_back(std::move(block));
+  }
+  IssueEvict(write_pos, enc_key, std::move(valid));
+  EvictExtraPaths(enc_key);
   ++size_;
 }
 
@@ -211,49 +259,54 @@ Pos ORam::GeneratePos() const {
   return res;
 }
 
-unsigned int ORam::PathAtLevel(Pos pos, unsigned int level) const {
-  unsigned int base = capacity_ - 1 + pos;
-  if (capacity_ > 1) base /= 2;
-  return (base / (1UL << (depth_ - level))) - 1;
+// Whether bucket idx is on the path of pos.
+bool ORam::OnPath(Pos pos, unsigned int idx) const {
+  unsigned int index = capacity_ - 1 + pos;
+  if (capacity_ > 1) // Corner case
+    index /= 2; // Skip last level
+  return utils::IsHeapAncestor(idx + 1, index);
 }
 
+// Leaf first. When the capacity is not a power of two, the paths of the
+// smallest positions end one level above the others.
 std::vector<unsigned int> ORam::Path(Pos pos) const {
   assert(1 <= pos && pos <= capacity_);
-  std::vector<unsigned int> res(depth_ + 1);
-  unsigned int i = 0;
+  std::vector<unsigned int> res;
+  res.reserve(depth_ + 1);
   unsigned int index = capacity_ - 1 + pos;
   if (capacity_ > 1) // Corner case
     index /= 2; // Skip last level
   while (index > 0) {
-    res[i++] = index - 1; // index is 1-based but we need 0-based array indexes.
+    res.push_back(index - 1); // index is 1-based but we need 0-based array indexes.
     index /= 2;
   }
   return res;
 }
 
-Block ORam::ReadPath(Pos p, Key k, crypto::Key enc_key) {
+Block ORam::ReadPath(Pos p, Key k, crypto::Key enc_key,
+                     BucketValidity &valid) {
   Block res(true);
   auto path = Path(p);
   ++memory_access_count_;
-  memory_access_bytes_total_ +=
-      path.size() * sizeof(EncryptedBucketSize(val_len_));
+  memory_access_bytes_total_ += path.size() * EncryptedBucketLen();
   for (auto it = path.rbegin(); it < path.rend(); ++it) {
     auto idx = *it;
-    if (!bucket_valid_[idx]) {
+    if (!valid[idx]) {
       break;
     }
-    auto eb = store_->Read(idx);
-    auto plen = crypto::Decrypt(eb, EncryptedBucketSize(val_len_),
-                                enc_key, bucket_buffer_.get());
-    assert(plen == BucketSize(val_len_));
-    auto bu = Bucket(bucket_buffer_.get(), val_len_);
-    bucket_valid_[(2 * idx) + 1] = bu.meta_.flags_ & kLeftChildValid;
-    bucket_valid_[(2 * idx) + 2] = bu.meta_.flags_ & kRightChildValid;
-    for (int i = 0; i < kBucketSize; ++i) {
+    if (opts_.async_evict_)
+      WaitForBucket(idx);
+    auto bu = DecodeBucket(idx, store_->Read(idx), enc_key,
+                           bucket_buffer_.get());
+    valid[(2 * idx) + 1] = bu.meta_.flags_ & kLeftChildValid;
+    valid[(2 * idx) + 2] = bu.meta_.flags_ & kRightChildValid;
+    std::lock_guard<std::mutex> lock(mu_);
+    for (unsigned int i = 0; i < opts_.bucket_size_; ++i) {
       if (!(bu.meta_.flags_ & kBlockValid[i]))
         break;
       if (k == bu.blocks_[i].meta_.key_) {
         res = std::move(bu.blocks_[i]);
+        OpenPayload(res, enc_key);
       } else {
         stash_.push_back(std::move(bu.blocks_[i]));
       }
@@ -262,44 +315,112 @@ Block ORam::ReadPath(Pos p, Key k, crypto::Key enc_key) {
   return std::move(res);
 }
 
-// Evict takes Pos as input as we can evict a different path than the path read.
-void ORam::Evict(Pos p, crypto::Key enc_key) {
+// Caller must hold mu_.
+Block ORam::TakeFromStash(Pos p, Key k) {
+  auto it = stash_.begin();
+  while (it < stash_.end()) {
+    if (it->meta_.key_ == k && it->meta_.pos_ == p)
+      break;
+    ++it;
+  }
+  if (it == stash_.end())
+    return Block(true);
+  Block res = std::move(*it);
+  stash_.erase(it);
+  return res;
+}
+
+// Evicting takes Pos as input as we can evict a different path than the path
+// read. The write-back is done inline, or queued for the evictor thread.
+void ORam::IssueEvict(Pos p, crypto::Key enc_key, BucketValidity valid) {
   auto path = Path(p);
   ++memory_access_count_;
-  memory_access_bytes_total_ += path.size() * EncryptedBucketSize(val_len_);
-  std::vector<bool> deleted_from_stash(stash_.size());
-  unsigned int level = depth_;
-  for (unsigned int idx : path) {
-    Bucket bu;
-    int bucket_index = 0;
-
-    for (int i = 0; i < stash_.size() && bucket_index < kBucketSize; i++) {
-      if (deleted_from_stash[i])
-        continue;
-      if (PathAtLevel(stash_[i].meta_.pos_, level) == idx) {
-        bu.blocks_[bucket_index] = std::move(stash_[i]);
-        deleted_from_stash[i] = true;
-//        stash_.erase(stash_.begin() + i);
-//        --i;
-        bu.meta_.flags_ |= kBlockValid[bucket_index];
-        ++bucket_index;
-      }
-    }
+  memory_access_bytes_total_ += path.size() * EncryptedBucketLen();
+  root_valid_ = true;
+
+  if (!opts_.async_evict_) {
+    auto buckets = PlaceOnPath(p, valid);
+    for (unsigned int i = 0; i < path.size(); ++i)
+      WriteBucket(path[i], buckets[i], enc_key,
+                  bucket_buffer_.get(), enc_bucket_buffer_.get());
+    return;
+  }
 
-    bucket_valid_[idx] = true;
-    if (bucket_valid_[(2 * idx) + 1])
-      bu.meta_.flags_ |= kLeftChildValid;
-    if (bucket_valid_[(2 * idx) + 2])
-      bu.meta_.flags_ |= kRightChildValid;
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    for (unsigned int idx : path)
+      ++pending_writes_[idx];
+    evict_queue_.push_back({p, enc_key, std::move(valid)});
+  }
+  cv_.notify_all();
+}
 
-    bu.ToBytes(bucket_buffer_.get(), val_len_);
-    auto success = crypto::Encrypt(bucket_buffer_.get(), BucketSize(val_len_),
-                                   enc_key, enc_bucket_buffer_.get());
-    assert(success);
-    store_->Write(idx, enc_bucket_buffer_.get());
-    level--;
+void ORam::EvictExtraPaths(crypto::Key enc_key) {
+  for (unsigned int i = 0; i < opts_.extra_evictions_; ++i) {
+    auto p = NextEvictionPos();
+    auto valid = NewBucketValidity();
+    ReadPath(p, 0, enc_key, valid);
+    IssueEvict(p, enc_key, std::move(valid));
   }
+}
+
+// The leaf buckets are visited in reverse-lexicographic order: the counter's
+// bits are reversed, so consecutive evictions split at the root, then at the
+// children of the root, and so on. When the capacity is not a power of two
+// the last level is not full, and leaves past it are skipped.
+Pos ORam::NextEvictionPos() {
+  if (capacity_ <= 1)
+    return 1;
+  size_t num_leaves = 1UL << depth_;
+  while (true) {
+    uint64_t g = evict_counter_++ % num_leaves;
+    Pos leaf = 0;
+    for (unsigned int i = 0; i < depth_; ++i)
+      leaf |= ((g >> i) & 1U) << (depth_ - 1 - i);
+    // Positions 2*leaf + 1 and 2*leaf + 2 share the leaf bucket.
+    if ((2 * leaf) + 1 <= capacity_)
+      return (2 * leaf) + 1;
+  }
+}
+
+// Moves stash blocks into the buckets of the path, deepest bucket first.
+// Returns the buckets in the order of Path(p). Caller must hold mu_ when
+// evicting asynchronously.
+std::vector<Bucket> ORam::PlaceOnPath(Pos p, BucketValidity &valid) {
+  auto path = Path(p);
+  std::vector<Bucket> res(path.size());
+  std::vector<bool> deleted_from_stash(stash_.size());
+  for (unsigned int j = 0; j < path.size(); ++j)
+    FillBucket(path[j], res[j], deleted_from_stash, valid);
+  EraseFromStash(deleted_from_stash);
+  return res;
+}
+
+// Children of idx must be filled before idx.
+void ORam::FillBucket(unsigned int idx, Bucket &bu,
+                      std::vector<bool> &deleted_from_stash,
+                      BucketValidity &valid) {
+  unsigned int bucket_index = 0;
+  for (size_t i = 0; i < stash_.size() && bucket_index < opts_.bucket_size_;
+       i++) {
+    if (deleted_from_stash[i])
+      continue;
+    if (OnPath(stash_[i].meta_.pos_, idx)) {
+      bu.blocks_[bucket_index] = std::move(stash_[i]);
+      deleted_from_stash[i] = true;
+      bu.meta_.flags_ |= kBlockValid[bucket_index];
+      ++bucket_index;
+    }
+  }
+
+  valid[idx] = true;
+  if (valid[(2 * idx) + 1])
+    bu.meta_.flags_ |= kLeftChildValid;
+  if (valid[(2 * idx) + 2])
+    bu.meta_.flags_ |= kRightChildValid;
+}
 
+void ORam::EraseFromStash(const std::vector<bool> &deleted_from_stash) {
   // Src: https://stackoverflow.com/a/33494562/3338591
   auto it = deleted_from_stash.begin();
   stash_.erase(
@@ -308,32 +429,422 @@ void ORam::Evict(Pos p, crypto::Key enc_key) {
                      [&](Block &) { return *it++; }),
       stash_.end()
   );
-  bucket_valid_.clear();
-  bucket_valid_[0] = true;
+}
+
+Bucket ORam::DecodeBucket(unsigned int idx, const uint8_t *enc_bucket,
+                          crypto::Key enc_key, uint8_t *buffer) const {
+  if (!opts_.split_buckets_) {
+    auto plen = crypto::Decrypt(enc_bucket, EncryptedBucketLen(),
+                                enc_key, buffer);
+    assert(plen == BucketLen());
+    return {buffer, val_len_, opts_.bucket_size_};
+  }
+
+  // Only the header is decrypted; valid payloads are copied out as is.
+  const auto z = opts_.bucket_size_;
+  const auto header_len = crypto::CiphertextLen(BucketHeaderSize(z));
+  const auto payload_len = crypto::CiphertextLen(val_len_);
+  std::array<uint8_t, crypto::CiphertextLen(BucketHeaderSize(kBucketSize))>
+      header{};
+  auto plen = crypto::Decrypt(enc_bucket, header_len, enc_key, header.data());
+  assert(plen == BucketHeaderSize(z));
+
+  Bucket res;
+  bytes::FromBytes(header.data(), res.meta_);
+  size_t offset = sizeof(BucketMetadata);
+  for (unsigned int i = 0; i < z; ++i) {
+    bytes::FromBytes(header.data() + offset, res.blocks_[i].meta_);
+    offset += sizeof(BlockMetadata);
+    if (!(res.meta_.flags_ & kBlockValid[i]))
+      continue;
+    auto payload = enc_bucket + header_len + (i * payload_len);
+    res.blocks_[i].enc_val_ = std::make_unique<uint8_t[]>(payload_len);
+    std::copy_n(payload, payload_len, res.blocks_[i].enc_val_.get());
+    res.blocks_[i].home_ = idx;
+  }
+  return res;
+}
+
+// Decrypts the payload of a block read from a split bucket, if still needed.
+void ORam::OpenPayload(Block &b, crypto::Key enc_key) const {
+  if (!b.enc_val_)
+    return;
+  const auto payload_len = crypto::CiphertextLen(val_len_);
+  // Sized for the ciphertext, as decryption may write whole cipher blocks.
+  b.val_ = std::make_unique<uint8_t[]>(payload_len);
+  auto plen = crypto::Decrypt(b.enc_val_.get(), payload_len, enc_key,
+                              b.val_.get());
+  assert(plen == val_len_);
+  b.enc_val_.reset();
+}
+
+void ORam::WriteBucket(unsigned int idx, Bucket &bu, crypto::Key enc_key,
+                       uint8_t *buffer, uint8_t *enc_buffer) {
+  if (opts_.split_buckets_) {
+    WriteSplitBucket(idx, bu, enc_key, enc_buffer);
+    return;
+  }
+  bu.ToBytes(buffer, val_len_, opts_.bucket_size_);
+  auto success = crypto::Encrypt(buffer, BucketLen(),
+                                 enc_key, enc_buffer);
+  assert(success);
+  store_->Write(idx, enc_buffer);
+}
+
+// Payloads still encrypted from this very bucket are written back unchanged;
+// every other slot, empty ones included, is encrypted afresh.
+void ORam::WriteSplitBucket(unsigned int idx, Bucket &bu, crypto::Key enc_key,
+                            uint8_t *enc_buffer) const {
+  const auto z = opts_.bucket_size_;
+  const auto header_len = crypto::CiphertextLen(BucketHeaderSize(z));
+  const auto payload_len = crypto::CiphertextLen(val_len_);
+  std::array<uint8_t, BucketHeaderSize(kBucketSize)> header{};
+  const auto meta_f = reinterpret_cast<const uint8_t *> (&bu.meta_);
+  std::copy(meta_f, meta_f + sizeof(BucketMetadata), header.data());
+  size_t offset = sizeof(BucketMetadata);
+  for (unsigned int i = 0; i < z; ++i) {
+    const auto block_meta_f =
+        reinterpret_cast<const uint8_t *> (&bu.blocks_[i].meta_);
+    std::copy(block_meta_f, block_meta_f + sizeof(BlockMetadata),
+              header.data() + offset);
+    offset += sizeof(BlockMetadata);
+  }
+  bool ok = crypto::Encrypt(header.data(), BucketHeaderSize(z), enc_key,
+                            enc_buffer);
+  assert(ok);
+
+  for (unsigned int i = 0; i < z; ++i) {
+    auto &b = bu.blocks_[i];
+    auto payload = enc_buffer + header_len + (i * payload_len);
+    if (!(bu.meta_.flags_ & kBlockValid[i])) {
+      ok = crypto::Encrypt(zero_val_.get(), val_len_, enc_key, payload);
+    } else if (b.enc_val_ && b.home_ == idx) {
+      std::copy_n(b.enc_val_.get(), payload_len, payload);
+    } else {
+      OpenPayload(b, enc_key);
+      auto val = b.val_ ? b.val_.get() : zero_val_.get();
+      ok = crypto::Encrypt(val, val_len_, enc_key, payload);
+    }
+    assert(ok);
+  }
+  store_->Write(idx, enc_buffer);
+}
+
+void ORam::WaitForBucket(unsigned int idx) {
+  std::unique_lock<std::mutex> lock(mu_);
+  cv_.wait(lock, [&] {
+    return pending_writes_.find(idx) == pending_writes_.end();
+  });
+}
+
+void ORam::WaitForEvictions() {
+  if (!opts_.async_evict_)
+    return;
+  std::unique_lock<std::mutex> lock(mu_);
+  cv_.wait(lock, [&] { return pending_writes_.empty(); });
+}
+
+void ORam::EvictLoop() {
+  auto buffer = std::make_unique<uint8_t[]>(BucketLen());
+  auto enc_buffer = std::make_unique<uint8_t[]>(EncryptedBucketLen());
+  std::unique_lock<std::mutex> lock(mu_);
+  while (true) {
+    cv_.wait(lock, [&] { return stop_evictor_ || !evict_queue_.empty(); });
+    if (evict_queue_.empty())
+      return; // Stopped, and nothing left to write.
+
+    auto job = std::move(evict_queue_.front());
+    evict_queue_.pop_front();
+    auto path = Path(job.pos_);
+    auto buckets = PlaceOnPath(job.pos_, job.valid_);
+    lock.unlock();
+
+    // Top-down, so that the next access can start reading its path early.
+    for (auto i = path.size(); i-- > 0;) {
+      WriteBucket(path[i], buckets[i], job.enc_key_,
+                  buffer.get(), enc_buffer.get());
+      lock.lock();
+      if (!--pending_writes_[path[i]])
+        pending_writes_.erase(path[i]);
+      lock.unlock();
+      cv_.notify_all();
+    }
+    lock.lock();
+  }
+}
+
+void ORam::UpdateBatch(
+    const std::vector<Key> &keys, size_t num_paths,
+    const std::function<std::vector<Block>(std::vector<Block>)> &update,
+    crypto::Key enc_key, utils::ThreadPool *pool) {
+  assert(with_pos_map_);
+  assert(keys.size() <= num_paths);
+  WaitForEvictions();
+
+  std::vector<Pos> paths;
+  std::vector<Pos> old_pos(keys.size(), 0);
+  for (unsigned int i = 0; i < keys.size(); ++i) {
+    auto it = pos_map_.find(keys[i]);
+    if (it == pos_map_.end())
+      continue;
+    old_pos[i] = it->second;
+    paths.push_back(it->second);
+    pos_map_.erase(it);
+  }
+  while (paths.size() < num_paths)
+    paths.push_back(GeneratePos());
+  for (size_t i = 0; i < num_paths * opts_.extra_evictions_; ++i)
+    paths.push_back(NextEvictionPos());
+
+  auto valid = NewBucketValidity();
+  ReadPaths(paths, enc_key, valid, pool);
+  std::vector<Block> fetched;
+  for (unsigned int i = 0; i < keys.size(); ++i) {
+    if (old_pos[i])
+      fetched.push_back(TakeFromStash(old_pos[i], keys[i]));
+    else
+      fetched.emplace_back(true);
+    OpenPayload(fetched.back(), enc_key);
+    if (fetched.back().meta_.key_)
+      --size_;
+  }
+
+  for (auto &b : update(std::move(fetched))) {
+    b.meta_.pos_ = GeneratePos();
+    pos_map_[b.meta_.key_] = b.meta_.pos_;
+    stash_.push_back(std::move(b));
+    ++size_;
+  }
+  EvictPaths(paths, enc_key, valid, pool);
+}
+
+void ORam::InsertBatch(std::vector<Block> blocks, size_t num_evictions,
+                       crypto::Key enc_key, utils::ThreadPool *pool) {
+  assert(blocks.size() <= num_evictions);
+  WaitForEvictions();
+
+  std::vector<Pos> paths;
+  for (size_t i = 0; i < num_evictions; ++i)
+    paths.push_back(NextEvictionPos());
+  auto valid = NewBucketValidity();
+  ReadPaths(paths, enc_key, valid, pool);
+  for (auto &b : blocks) {
+    if (with_pos_map_) {
+      b.meta_.pos_ = GeneratePos();
+      pos_map_[b.meta_.key_] = b.meta_.pos_;
+    }
+    stash_.push_back(std::move(b));
+    ++size_;
+  }
+  EvictPaths(paths, enc_key, valid, pool);
+}
+
+std::vector<std::vector<unsigned int>> ORam::BucketsByLevel(
+    const std::vector<Pos> &ps) const {
+  std::vector<std::vector<unsigned int>> res(depth_ + 1);
+  for (auto p : ps) {
+    auto path = Path(p);
+    for (unsigned int j = 0; j < path.size(); ++j)
+      res[path.size() - 1 - j].push_back(path[j]);
+  }
+  for (auto &level : res) {
+    std::sort(level.begin(), level.end());
+    level.erase(std::unique(level.begin(), level.end()), level.end());
+  }
+  return res;
+}
+
+// Like ReadPath, but for the union of the paths of `ps`, one level at a time.
+// All blocks found are moved to the stash.
+void ORam::ReadPaths(const std::vector<Pos> &ps, crypto::Key enc_key,
+                     BucketValidity &valid, utils::ThreadPool *pool) {
+  auto levels = BucketsByLevel(ps);
+  const auto enc_size = EncryptedBucketLen();
+  const auto size = BucketLen();
+  ++memory_access_count_;
+  for (auto &level : levels)
+    memory_access_bytes_total_ += level.size() * enc_size;
+
+  for (auto &level : levels) {
+    std::vector<unsigned int> idxs;
+    for (auto idx : level)
+      if (valid[idx])
+        idxs.push_back(idx);
+    if (idxs.empty())
+      break;
+
+    // Copied out first, as a store's Read buffer may be reused.
+    auto enc = std::make_unique<uint8_t[]>(idxs.size() * enc_size);
+    for (unsigned int i = 0; i < idxs.size(); ++i)
+      std::copy_n(store_->Read(idxs[i]), enc_size, enc.get() + (i * enc_size));
+
+    auto plain = std::make_unique<uint8_t[]>(idxs.size() * size);
+    std::vector<Bucket> buckets(idxs.size());
+    auto decrypt = [&](size_t i) {
+      buckets[i] = DecodeBucket(idxs[i], enc.get() + (i * enc_size), enc_key,
+                                plain.get() + (i * size));
+    };
+    if (pool)
+      pool->ParallelFor(idxs.size(), decrypt);
+    else
+      for (unsigned int i = 0; i < idxs.size(); ++i)
+        decrypt(i);
+
+    for (unsigned int i = 0; i < idxs.size(); ++i) {
+      auto &bu = buckets[i];
+      valid[(2 * idxs[i]) + 1] = bu.meta_.flags_ & kLeftChildValid;
+      valid[(2 * idxs[i]) + 2] = bu.meta_.flags_ & kRightChildValid;
+      for (unsigned int j = 0; j < opts_.bucket_size_; ++j) {
+        if (!(bu.meta_.flags_ & kBlockValid[j]))
+          break;
+        stash_.push_back(std::move(bu.blocks_[j]));
+      }
+    }
+  }
+}
+
+// Like evicting a single path, but for the union of the paths of `ps`. Every
+// bucket is written once, however many of the paths share it.
+void ORam::EvictPaths(const std::vector<Pos> &ps, crypto::Key enc_key,
+                      BucketValidity &valid, utils::ThreadPool *pool) {
+  auto levels = BucketsByLevel(ps);
+  const auto enc_size = EncryptedBucketLen();
+  const auto size = BucketLen();
+  std::vector<unsigned int> idxs;
+  for (auto level = levels.rbegin(); level != levels.rend(); ++level)
+    idxs.insert(idxs.end(), level->begin(), level->end());
+  ++memory_access_count_;
+  memory_access_bytes_total_ += idxs.size() * enc_size;
+  root_valid_ = true;
+
+  // Deepest level first, so children are filled before their parents.
+  std::vector<Bucket> buckets(idxs.size());
+  std::vector<bool> deleted_from_stash(stash_.size());
+  unsigned int i = 0;
+  for (int level = depth_; level >= 0; --level)
+    for (auto idx : levels[level])
+      FillBucket(idx, buckets[i++], deleted_from_stash, valid);
+  EraseFromStash(deleted_from_stash);
+
+  auto plain = std::make_unique<uint8_t[]>(idxs.size() * size);
+  auto enc = std::make_unique<uint8_t[]>(idxs.size() * enc_size);
+  auto write = [&](size_t j) {
+    WriteBucket(idxs[j], buckets[j], enc_key,
+                plain.get() + (j * size), enc.get() + (j * enc_size));
+  };
+  if (pool)
+    pool->ParallelFor(idxs.size(), write);
+  else
+    for (unsigned int j = 0; j < idxs.size(); ++j)
+      write(j);
+}
+
+ORam::BucketValidity ORam::NewBucketValidity() const {
+  return {{0, root_valid_}};
 }
 
 void ORam::DummyAccess(crypto::Key enc_key) {
   auto p = GeneratePos();
-  ReadPath(p, 0, enc_key);
-  Evict(p, enc_key);
+  auto valid = NewBucketValidity();
+  ReadPath(p, 0, enc_key, valid);
+  IssueEvict(p, enc_key, std::move(valid));
+  EvictExtraPaths(enc_key);
 }
 
 // Should only be called after allocation.
 void ORam::FillWithDummies(crypto::Key enc_key) {
+  WaitForEvictions();
   ++memory_access_count_;
-  memory_access_bytes_total_ += num_buckets_ * EncryptedBucketSize(val_len_);
+  memory_access_bytes_total_ += num_buckets_ * EncryptedBucketLen();
   Bucket empty;
-  empty.ToBytes(bucket_buffer_.get(), val_len_);
+  if (opts_.split_buckets_) {
+    for (unsigned int i = 0; i < num_buckets_; ++i)
+      WriteSplitBucket(i, empty, enc_key, enc_bucket_buffer_.get());
+    return;
+  }
+  empty.ToBytes(bucket_buffer_.get(), val_len_, opts_.bucket_size_);
 
   for (unsigned int i = 0; i < num_buckets_; ++i) {
     // Re-encrypt each bucket with fresh randomness
-    bool ok = crypto::Encrypt(bucket_buffer_.get(), BucketSize(val_len_),
+    bool ok = crypto::Encrypt(bucket_buffer_.get(), BucketLen(),
                               enc_key, enc_bucket_buffer_.get());
     assert(ok);
     store_->Write(i, enc_bucket_buffer_.get());
   }
 }
 
+// Should only be called after allocation.
+void ORam::BulkLoad(std::vector<Block> blocks, crypto::Key enc_key) {
+  WaitForEvictions();
+  ++memory_access_count_;
+  memory_access_bytes_total_ += num_buckets_ * EncryptedBucketLen();
+  root_valid_ = true;
+
+  // Blocks that may still go in each bucket, starting from their leaves.
+  std::vector<std::vector<Block>> waiting(num_buckets_);
+  for (auto &b : blocks) {
+    if (with_pos_map_) {
+      b.meta_.pos_ = GeneratePos();
+      pos_map_[b.meta_.key_] = b.meta_.pos_;
+    }
+    waiting[Path(b.meta_.pos_)[0]].push_back(std::move(b));
+    ++size_;
+  }
+
+  // Children have larger indexes than their parents.
+  for (size_t i = num_buckets_; i-- > 0;) {
+    Bucket bu;
+    auto &here = waiting[i];
+    unsigned int j = 0;
+    for (; j < here.size() && j < opts_.bucket_size_; ++j) {
+      bu.blocks_[j] = std::move(here[j]);
+      bu.meta_.flags_ |= kBlockValid[j];
+    }
+    auto &rest = i ? waiting[(i - 1) / 2] : stash_;
+    std::move(here.begin() + j, here.end(), std::back_inserter(rest));
+    here = std::vector<Block>();
+
+    if ((2 * i) + 1 < num_buckets_)
+      bu.meta_.flags_ |= kLeftChildValid;
+    if ((2 * i) + 2 < num_buckets_)
+      bu.meta_.flags_ |= kRightChildValid;
+    WriteBucket(i, bu, enc_key, bucket_buffer_.get(),
+                enc_bucket_buffer_.get());
+  }
+}
+
+std::vector<Block> ORam::TakeAll(crypto::Key enc_key) {
+  WaitForEvictions();
+  ++memory_access_count_;
+  std::vector<Block> res = std::move(stash_);
+  stash_.clear();
+  std::vector<bool> valid(num_buckets_);
+  valid[0] = root_valid_;
+  // Parents come first, and tell whether their children were written.
+  for (size_t i = 0; i < num_buckets_; ++i) {
+    if (!valid[i])
+      continue;
+    memory_access_bytes_total_ += EncryptedBucketLen();
+    auto bu = DecodeBucket(i, store_->Read(i), enc_key, bucket_buffer_.get());
+    if ((2 * i) + 1 < num_buckets_)
+      valid[(2 * i) + 1] = bu.meta_.flags_ & kLeftChildValid;
+    if ((2 * i) + 2 < num_buckets_)
+      valid[(2 * i) + 2] = bu.meta_.flags_ & kRightChildValid;
+    for (unsigned int j = 0; j < opts_.bucket_size_; ++j)
+      if (bu.meta_.flags_ & kBlockValid[j])
+        res.push_back(std::move(bu.blocks_[j]));
+  }
+  for (auto &b : res)
+    OpenPayload(b, enc_key);
+
+  root_valid_ = false;
+  size_ = 0;
+  pos_map_.clear();
+  next_key_ = 1;
+  freed_keys_.clear();
+  return res;
+}
+
 Key ORam::NextKey() {
   assert(with_key_gen_);
   if (!freed_keys_.empty()) {
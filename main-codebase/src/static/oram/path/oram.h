@@ -1,14 +1,21 @@
 #ifndef DYNO_STATIC_ORAM_PATH_ORAM_H
 #define DYNO_STATIC_ORAM_PATH_ORAM_H
 
+#include <condition_variable>
 #include <cstdint>
+#include <deque>
+#include <functional>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <thread>
 #include <vector>
 #include <string>
 
 #include "../../../utils/crypto.h"
+#include "../../../utils/thread_pool.h"
 #include "../../../store/store.h"
+#include "../../../store/store_pool.h"
 
 namespace dyno::static_path_oram {
 
@@ -38,6 +45,10 @@ class Block {
  public:
   BlockMetadata meta_;
   Val val_;
+  // Split buckets only: the payload as read from bucket `home_`, still
+  // encrypted. Set instead of val_ until the payload is needed.
+  Val enc_val_;
+  unsigned int home_ = 0;
 
   explicit Block(bool zero_fill = false) : meta_(zero_fill) {}
   Block(Pos p, Key k, Val v) : meta_(p, k), val_(std::move(v)) {}
@@ -63,12 +74,14 @@ class BucketMetadata {
   uint8_t flags_ = 0; // Only for optimizations.
 };
 
-static size_t BucketSize(size_t val_len) {
-  return sizeof(BucketMetadata) + (kBucketSize * BlockSize(val_len));
+// `z` is the number of blocks per bucket actually stored (≤ kBucketSize).
+static size_t BucketSize(size_t val_len, unsigned int z = kBucketSize) {
+  return sizeof(BucketMetadata) + (z * BlockSize(val_len));
 }
 
-static size_t EncryptedBucketSize(size_t val_len) {
-  return crypto::CiphertextLen(BucketSize(val_len));
+static size_t EncryptedBucketSize(size_t val_len,
+                                  unsigned int z = kBucketSize) {
+  return crypto::CiphertextLen(BucketSize(val_len, z));
 }
 
 class Bucket {
@@ -77,28 +90,104 @@ class Bucket {
   BucketMetadata meta_{0};
 
   Bucket() = default;
-  Bucket(uint8_t *data, size_t val_len);
+  Bucket(uint8_t *data, size_t val_len, unsigned int z = kBucketSize);
 
-  std::unique_ptr<uint8_t[]> ToBytes(size_t val_len);
-  void ToBytes(uint8_t *res, size_t val_len);
+  std::unique_ptr<uint8_t[]> ToBytes(size_t val_len,
+                                     unsigned int z = kBucketSize);
+  void ToBytes(uint8_t *res, size_t val_len, unsigned int z = kBucketSize);
 };
 
-// Assumes 1-based positions ([1, N]) and power-of-two sizes.
+// Optional behavior; the defaults give the classic synchronous PathORAM.
+class Options {
+ public:
+  // Evict on a background worker. Read and ReadAndRemove return as soon as the
+  // requested block is found, and a later access only waits for the buckets of
+  // its own path that are still being written back.
+  bool async_evict_ = false;
+  // Z, the number of blocks per bucket; in [1, kBucketSize]. Smaller buckets
+  // move fewer bytes per path, and should be paired with extra evictions to
+  // keep the stash small.
+  unsigned int bucket_size_ = kBucketSize;
+  // Paths evicted per access on top of the accessed one. They are picked in
+  // reverse-lexicographic order of their leaves (as in Ring ORAM), so they do
+  // not depend on the accesses. Each one is a full path read and write.
+  unsigned int extra_evictions_ = 0;
+  // Store each bucket as an encrypted header with the metadata of all its
+  // blocks, followed by one separately encrypted payload per slot. Accesses
+  // decrypt the headers, but only the payload of the requested block; a
+  // payload that is written back to the bucket it was read from keeps its
+  // ciphertext. This saves most of the crypto for large values, at the cost
+  // of revealing which payload slots were left unchanged by an eviction, i.e.
+  // which blocks stayed in their bucket. Buckets also get larger, by one IV
+  // and padding per slot.
+  bool split_buckets_ = false;
+  // Take the store from this pool, which then decides where it lives (the
+  // file_path and max_levels_in_mem arguments are ignored), and give it back
+  // on destruction. The pool must outlive the ORAM.
+  store::StorePool *store_pool_ = nullptr;
+};
+
+static constexpr size_t BucketHeaderSize(unsigned int z) {
+  return sizeof(BucketMetadata) + (z * sizeof(BlockMetadata));
+}
+
+// Size of a bucket in the store.
+static size_t StoredBucketSize(size_t val_len, const Options &opts) {
+  if (!opts.split_buckets_)
+    return EncryptedBucketSize(val_len, opts.bucket_size_);
+  return crypto::CiphertextLen(BucketHeaderSize(opts.bucket_size_))
+      + (opts.bucket_size_ * crypto::CiphertextLen(val_len));
+}
+
+// Assumes 1-based positions ([1, N]). Any N works: the tree is heap-shaped
+// with N leaves, so when N is not a power of two the last level is not full
+// and some paths are one bucket shorter (see Path).
 class ORam {
  public:
   // RAM
   ORam(size_t n, size_t val_len,
-       bool with_pos_map = false, bool with_key_gen = false);
+       bool with_pos_map = false, bool with_key_gen = false,
+       Options opts = Options());
   // PosixSingleFile -- On file store error reverts to RAM store.
   ORam(size_t n, size_t val_len, const std::string &file_path,
        uint8_t max_levels_in_mem = 0,
-       bool with_pos_map = false, bool with_key_gen = false);
+       bool with_pos_map = false, bool with_key_gen = false,
+       Options opts = Options());
+  ~ORam();
 
   Block ReadAndRemove(Pos p, Key k, crypto::Key enc_key);
   Block Read(Pos p, Key k, crypto::Key enc_key);
   void Insert(Block block, crypto::Key enc_key);
   void DummyAccess(crypto::Key enc_key);
+  // Batched ReadAndRemove + Insert; only works when `with_pos_map = true`.
+  // Removes the blocks of the (distinct) `keys`, reading each bucket on the
+  // union of their paths once; the union is padded with random paths up to
+  // `num_paths` paths. The removed blocks, zero-filled when absent, are passed
+  // to `update`, and the blocks it returns are written back with fresh
+  // positions while evicting the same paths. Buckets are decrypted and
+  // encrypted on `pool` when given.
+  void UpdateBatch(
+      const std::vector<Key> &keys, size_t num_paths,
+      const std::function<std::vector<Block>(std::vector<Block>)> &update,
+      crypto::Key enc_key, utils::ThreadPool *pool = nullptr);
+  // Puts all `blocks` in the stash, then evicts `num_evictions` (at least
+  // |blocks|) paths picked in reverse-lexicographic order, reading and writing
+  // each bucket on their union once. Costs about as much as `num_evictions`
+  // Inserts of which the shared upper buckets are only moved once.
+  void InsertBatch(std::vector<Block> blocks, size_t num_evictions,
+                   crypto::Key enc_key, utils::ThreadPool *pool = nullptr);
   void FillWithDummies(crypto::Key enc_key);
+  // Instead of FillWithDummies, right after allocation: places all `blocks` as
+  // deep on their paths as they fit, as if every path was evicted at once, and
+  // writes every bucket once. The overflow goes to the stash.
+  void BulkLoad(std::vector<Block> blocks, crypto::Key enc_key);
+  // The reverse of BulkLoad: reads every bucket that was ever written once, in
+  // index order, and returns all blocks, stash included. Leaves the ORAM empty,
+  // as if just allocated, keys and positions included.
+  std::vector<Block> TakeAll(crypto::Key enc_key);
+  // Blocks until all issued evictions are written back. No-op when eviction
+  // is synchronous.
+  void WaitForEvictions();
   [[nodiscard]] Pos GeneratePos() const;
   [[nodiscard]] size_t Capacity() const { return capacity_; }
   [[nodiscard]] size_t Size() const { return size_; }
@@ -125,17 +214,69 @@ class ORam {
   bool with_key_gen_ = false;
   Key next_key_ = 1;
   std::vector<Key> freed_keys_;
-  std::map<Pos, bool> bucket_valid_{};
+  bool root_valid_ = false;
+  uint64_t evict_counter_ = 0; // Reverse-lexicographic eviction counter.
   uint64_t memory_access_count_ = 0;
   uint64_t memory_access_bytes_total_ = 0;
   std::unique_ptr<uint8_t[]> bucket_buffer_;
   std::unique_ptr<uint8_t[]> enc_bucket_buffer_;
   bool is_on_disk_ = false;
+  const Options opts_;
+  const std::unique_ptr<uint8_t[]> zero_val_; // Payload of empty split slots.
+
+  // Whether the buckets on, and hanging off of, an accessed path were ever
+  // written. Filled by ReadPath and consumed by the eviction of the same path.
+  using BucketValidity = std::map<unsigned int, bool>;
+
+  class EvictJob {
+   public:
+    Pos pos_;
+    crypto::Key enc_key_;
+    BucketValidity valid_;
+  };
 
-  Block ReadPath(Pos p, Key k, crypto::Key enc_key);
-  void Evict(Pos p, crypto::Key enc_key);
+  // Guards stash_ and the eviction queue when evicting asynchronously.
+  std::mutex mu_;
+  std::condition_variable cv_;
+  std::deque<EvictJob> evict_queue_;
+  std::map<unsigned int, unsigned int> pending_writes_;
+  bool stop_evictor_ = false;
+  std::thread evictor_;
+
+  Block ReadPath(Pos p, Key k, crypto::Key enc_key, BucketValidity &valid);
+  Block TakeFromStash(Pos p, Key k);
+  void IssueEvict(Pos p, crypto::Key enc_key, BucketValidity valid);
+  void EvictExtraPaths(crypto::Key enc_key);
+  Pos NextEvictionPos();
+  std::vector<Bucket> PlaceOnPath(Pos p, BucketValidity &valid);
+  void FillBucket(unsigned int idx, Bucket &bu,
+                  std::vector<bool> &deleted_from_stash,
+                  BucketValidity &valid);
+  void EraseFromStash(const std::vector<bool> &deleted_from_stash);
+  void ReadPaths(const std::vector<Pos> &ps, crypto::Key enc_key,
+                 BucketValidity &valid, utils::ThreadPool *pool);
+  void EvictPaths(const std::vector<Pos> &ps, crypto::Key enc_key,
+                  BucketValidity &valid, utils::ThreadPool *pool);
+  [[nodiscard]] std::vector<std::vector<unsigned int>> BucketsByLevel(
+      const std::vector<Pos> &ps) const;
+  Bucket DecodeBucket(unsigned int idx, const uint8_t *enc_bucket,
+                      crypto::Key enc_key, uint8_t *buffer) const;
+  void OpenPayload(Block &b, crypto::Key enc_key) const;
+  void WriteBucket(unsigned int idx, Bucket &bu, crypto::Key enc_key,
+                   uint8_t *buffer, uint8_t *enc_buffer);
+  void WriteSplitBucket(unsigned int idx, Bucket &bu, crypto::Key enc_key,
+                        uint8_t *enc_buffer) const;
+  void WaitForBucket(unsigned int idx);
+  void EvictLoop();
+  [[nodiscard]] BucketValidity NewBucketValidity() const;
   [[nodiscard]] std::vector<unsigned int> Path(Pos pos) const;
-  [[nodiscard]] uint32_t PathAtLevel(Pos p, unsigned int level) const;
+  [[nodiscard]] size_t BucketLen() const {
+    return BucketSize(val_len_, opts_.bucket_size_);
+  }
+  [[nodiscard]] size_t EncryptedBucketLen() const {
+    return StoredBucketSize(val_len_, opts_);
+  }
+  [[nodiscard]] bool OnPath(Pos p, unsigned int idx) const;
 };
 
 } // namespace dyno::static_path_oram
@@ -34,6 +34,17 @@ class HybridStore : public Store {
     return stores_[s_idx]->Write(AddressInStore(i, s_idx), d);
   }
 
+  // Only resizes the last store; n must stay past the others.
+  bool Resize(size_t n) override {
+    size_t last = bounds_.size() - 1;
+    size_t start = last ? bounds_[last - 1] : 0;
+    size_t tail = n > start ? n - start : 0;
+    if (!stores_[last]->Resize(tail))
+      return false;
+    bounds_[last] = start + tail;
+    return true;
+  }
+
  protected:
   std::vector<std::unique_ptr<Store>> stores_;
   std::vector<size_t> bounds_;
@@ -87,6 +87,17 @@ class PosixSingleFileStore : public Store {
     return true;
   }
 
+  // ftruncate, so a larger file stays sparse until written.
+  bool Resize(size_t n) override {
+    if (::ftruncate(file_, n * entry_size_) == -1) {
+      std::clog << "Couldn't resize file; fd=" << file_ << ", path=" << path_
+                << ", to " << n << " entries; errno=" << errno << std::endl;
+      return false;
+    }
+    n_ = n;
+    return true;
+  }
+
   ~PosixSingleFileStore() override {
     ::close(file_);
   }
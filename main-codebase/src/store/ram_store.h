@@ -3,35 +3,90 @@
 
 #include "store.h"
 
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
 #include <algorithm>
 #include <cstddef>
 #include <memory>
+#include <new>
 #include <string>
 
 namespace dyno::store {
 
+// On Linux the buffer is an anonymous mapping: pages are only allocated (and
+// zeroed by the kernel) when first touched, and Resize remaps them instead of
+// copying.
 class RamStore : public Store {
  public:
   RamStore(size_t n, size_t entry_size)
-      : n_(n), entry_size_(entry_size), data_(new uint8_t[n * entry_size]) {}
+      : n_(n), entry_size_(entry_size), data_(Allocate(Bytes(n))) {}
+
+  ~RamStore() override { Free(data_, Bytes(n_)); }
 
-  uint8_t *Read(size_t i) {
+  RamStore(const RamStore &) = delete;
+  RamStore &operator=(const RamStore &) = delete;
+
+  uint8_t *Read(size_t i) override {
     if (i >= n_)
       return {};
-    return data_.get() + (i * entry_size_);
+    return data_ + (i * entry_size_);
   }
 
-  bool Write(size_t i, const uint8_t *d) {
+  bool Write(size_t i, const uint8_t *d) override {
     if ((i >= n_))
       return false;
-    std::copy_n(d, entry_size_, data_.get() + (i * entry_size_));
+    std::copy_n(d, entry_size_, data_ + (i * entry_size_));
+    return true;
+  }
+
+  bool Resize(size_t n) override {
+#ifdef __linux__
+    void *p = ::mremap(data_, Bytes(n_), Bytes(n), MREMAP_MAYMOVE);
+    if (p == MAP_FAILED)
+      return false;
+    data_ = static_cast<uint8_t *>(p);
+#else
+    auto p = Allocate(Bytes(n));
+    std::copy_n(data_, std::min(Bytes(n), Bytes(n_)), p);
+    Free(data_, Bytes(n_));
+    data_ = p;
+#endif
+    n_ = n;
     return true;
   }
 
  protected:
   size_t n_;
   size_t entry_size_;
-  std::unique_ptr<uint8_t[]> data_;
+  uint8_t *data_;
+
+ private:
+  // Never 0, which mmap rejects.
+  [[nodiscard]] size_t Bytes(size_t n) const {
+    return std::max<size_t>(1, n * entry_size_);
+  }
+
+  static uint8_t *Allocate(size_t len) {
+#ifdef __linux__
+    void *p = ::mmap(nullptr, len, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+      throw std::bad_alloc();
+    return static_cast<uint8_t *>(p);
+#else
+    return new uint8_t[len];
+#endif
+  }
+
+  static void Free(uint8_t *p, size_t len) {
+#ifdef __linux__
+    ::munmap(p, len);
+#else
+    delete[] p;
+#endif
+  }
 };
 
 } // namespace dyno::store
@@ -12,6 +12,9 @@ class Store {
   virtual ~Store() = default;
   virtual uint8_t *Read(size_t i) = 0;
   virtual bool Write(size_t i, const uint8_t *data) = 0;
+  // Changes the number of entries in place, keeping the first ones; entries
+  // past the old end are uninitialized. Returns false if unsupported.
+  virtual bool Resize(size_t /*n*/) { return false; }
 };
 
 } // namespace dyno::store
@@ -0,0 +1,136 @@
+#ifndef DYNO_STORE_STORE_POOL_H_
+#define DYNO_STORE_STORE_POOL_H_
+
+#include "store.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "hybrid_store.h"
+#include "posix_single_file_store.h"
+#include "ram_store.h"
+
+namespace dyno::store {
+
+// Stores for tree-shaped structures that come and go at different sizes, like
+// the sub-structures of the dynamic ones. A store given back is shrunk to
+// nothing right away (Store::Resize: a RAM buffer is remapped, a file
+// truncated; a hybrid store keeps its RAM part), so its memory is returned
+// then, and up to kMaxFree of them are kept. The next one of the same entry
+// size and kind is resized in place from one of those, instead of being
+// allocated anew and opening another file. Entries are not initialized; the
+// structures only read buckets they wrote.
+//
+// As in the static ORAM, the first (2 << max_levels_in_mem) - 1 entries of a
+// store are in RAM and the rest in a file; each store has its own file, at
+// path.0, path.1, ... All in RAM with an empty path. Thread-safe.
+class StorePool {
+ public:
+  explicit StorePool(std::string path = "", uint8_t max_levels_in_mem = 0)
+      : path_(std::move(path)), max_levels_in_mem_(max_levels_in_mem) {}
+
+  StorePool(const StorePool &) = delete;
+  StorePool &operator=(const StorePool &) = delete;
+
+  // On file store error reverts to RAM store. Sets *on_disk, when given, to
+  // whether part of the store is in a file.
+  std::unique_ptr<Store> Acquire(size_t n, size_t entry_size,
+                                 bool *on_disk = nullptr) {
+    std::lock_guard<std::mutex> lock(mu_);
+    Info info{n, entry_size, MemEntries(n)};
+    std::unique_ptr<Store> res;
+    for (auto it = free_.begin(); it != free_.end() && !res;) {
+      if (!info.SameKind(it->second)) {
+        ++it;
+        continue;
+      }
+      if (it->first->Resize(n))
+        res = std::move(it->first);
+      it = free_.erase(it); // Dropped if it cannot be resized.
+    }
+    if (!res)
+      res = Create(info);
+    if (on_disk)
+      *on_disk = info.mem_n_ < n;
+    in_use_[res.get()] = info;
+    return res;
+  }
+
+  // Takes back a store from Acquire, for reuse.
+  void Release(std::unique_ptr<Store> s) {
+    std::lock_guard<std::mutex> lock(mu_);
+    auto it = in_use_.find(s.get());
+    if (it == in_use_.end())
+      return;
+    // Dropped if it cannot be shrunk, or enough are kept already.
+    if (s->Resize(0) && free_.size() < kMaxFree)
+      free_.emplace_back(std::move(s), it->second);
+    in_use_.erase(it);
+  }
+
+ private:
+  class Info {
+   public:
+    size_t n_;
+    size_t entry_size_;
+    size_t mem_n_; // Entries in RAM; n_ when all are.
+
+    // Both all in RAM, or both with the same RAM part and the rest in a file.
+    [[nodiscard]] bool SameKind(const Info &o) const {
+      return entry_size_ == o.entry_size_
+          && (mem_n_ == n_) == (o.mem_n_ == o.n_)
+          && (mem_n_ == n_ || mem_n_ == o.mem_n_);
+    }
+  };
+
+  // A dynamic structure gives back at most one store per step.
+  static constexpr size_t kMaxFree = 2;
+
+  const std::string path_;
+  const uint8_t max_levels_in_mem_;
+  std::mutex mu_;
+  size_t next_file_ = 0;
+  std::map<const Store *, Info> in_use_;
+  std::vector<std::pair<std::unique_ptr<Store>, Info>> free_;
+
+  [[nodiscard]] size_t MemEntries(size_t n) const {
+    if (path_.empty() || max_levels_in_mem_ >= 8 * sizeof(size_t) - 1)
+      return n;
+    size_t mem = (2UL << max_levels_in_mem_) - 1;
+    return mem < n ? mem : n;
+  }
+
+  // Sets info.mem_n_ to n when it falls back to RAM.
+  std::unique_ptr<Store> Create(Info &info) {
+    if (info.mem_n_ == info.n_)
+      return std::make_unique<RamStore>(info.n_, info.entry_size_);
+
+    auto file = path_ + "." + std::to_string(next_file_++);
+    auto disk_store = PosixSingleFileStore::Construct(
+        info.n_ - info.mem_n_, info.entry_size_, file, true);
+    if (!disk_store) {
+      std::cerr << "Failed to create file store." << std::endl;
+      info.mem_n_ = info.n_;
+      return std::make_unique<RamStore>(info.n_, info.entry_size_);
+    }
+    if (!info.mem_n_)
+      return std::unique_ptr<Store>(disk_store.value());
+
+    std::vector<std::unique_ptr<Store>> s;
+    s.push_back(std::make_unique<RamStore>(info.mem_n_, info.entry_size_));
+    s.emplace_back(disk_store.value());
+    return std::unique_ptr<Store>(
+        new HybridStore(std::move(s), {info.mem_n_, info.n_}));
+  }
+};
+
+} // namespace dyno::store
+
+#endif //DYNO_STORE_STORE_POOL_H_
@@ -0,0 +1,100 @@
+#ifndef DYNO_UTILS_BACKGROUND_MIGRATOR_H_
+#define DYNO_UTILS_BACKGROUND_MIGRATOR_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+namespace dyno::utils {
+
+// A thread that runs `step` while `needed` holds, between the foreground
+// operations of the structure that owns it, e.g. the Grow steps of a dynamic
+// structure ahead of its inserts. Each operation holds a Lock for its whole
+// length, and the migrator runs both functions under the same (recursive)
+// mutex, so an operation sees the structure between two steps, never inside
+// one. It only starts a step when no operation is waiting for the mutex, and
+// is woken when one ends.
+//
+// Until Start is called, Lock holds nothing and costs nothing.
+class BackgroundMigrator {
+ public:
+  class Lock {
+   public:
+    Lock() = default;
+    explicit Lock(const BackgroundMigrator *m) : m_(m) {
+      ++m_->waiting_;
+      lock_ = std::unique_lock<std::recursive_mutex>(m_->mu_);
+      --m_->waiting_;
+    }
+    Lock(Lock &&) = default;
+    Lock &operator=(Lock &&) = delete;
+
+    ~Lock() {
+      if (!lock_.owns_lock())
+        return;
+      lock_.unlock();
+      m_->cv_.notify_one();
+    }
+
+   private:
+    const BackgroundMigrator *m_ = nullptr;
+    std::unique_lock<std::recursive_mutex> lock_;
+  };
+
+  BackgroundMigrator() = default;
+  ~BackgroundMigrator() { Stop(); }
+
+  BackgroundMigrator(const BackgroundMigrator &) = delete;
+  BackgroundMigrator &operator=(const BackgroundMigrator &) = delete;
+
+  // Called once, by the owner's constructor.
+  void Start(std::function<bool()> needed, std::function<void()> step) {
+    needed_ = std::move(needed);
+    step_ = std::move(step);
+    thread_ = std::thread(&BackgroundMigrator::Loop, this);
+  }
+
+  // Waits for the running step, if any, but not for the steps still needed.
+  void Stop() {
+    if (!thread_.joinable())
+      return;
+    {
+      Lock lock(this); // Gets in between two steps, as an operation does.
+      stop_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+  }
+
+  [[nodiscard]] Lock Foreground() const {
+    return thread_.joinable() ? Lock(this) : Lock();
+  }
+
+ private:
+  mutable std::recursive_mutex mu_;
+  mutable std::condition_variable_any cv_;
+  // Operations blocked on mu_; only changed by them, read under mu_.
+  mutable std::atomic<size_t> waiting_ = 0;
+  bool stop_ = false;
+  std::function<bool()> needed_;
+  std::function<void()> step_;
+  std::thread thread_;
+
+  void Loop() {
+    std::unique_lock<std::recursive_mutex> lock(mu_);
+    while (true) {
+      cv_.wait(lock, [&] { return stop_ || (!waiting_ && needed_()); });
+      if (stop_)
+        return;
+      step_();
+    }
+  }
+};
+
+} // namespace dyno::utils
+
+#endif //DYNO_UTILS_BACKGROUND_MIGRATOR_H_
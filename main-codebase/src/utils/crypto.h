@@ -9,6 +9,7 @@
 #include <openssl/aes.h>
 #include <openssl/err.h>
 #include <openssl/evp.h>
+#include <openssl/hmac.h>
 #include <openssl/rand.h>
 
 namespace dyno::crypto {
@@ -62,6 +63,18 @@ inline bool Hash(const uint8_t *val, const size_t val_len, uint8_t *res) {
   return true;
 }
 
+// Keyed PRF (HMAC with kDigest); writes kDigestSize bytes to res.
+inline bool Prf(const Key key, const uint8_t *val, const size_t val_len,
+                uint8_t *res) {
+  unsigned int res_len = 0;
+  if (!HMAC(kDigest(), key.data(), key.size(), val, val_len, res, &res_len)) {
+    ERR_print_errors_fp(stderr);
+    return false;
+  }
+  assert(res_len == kDigestSize);
+  return true;
+}
+
 constexpr inline size_t CiphertextLen(size_t plaintext_len) {
   return (((plaintext_len + kBlockSize) / kBlockSize) * kBlockSize) + kIvSize;
 }
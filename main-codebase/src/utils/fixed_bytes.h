@@ -0,0 +1,64 @@
+#ifndef DYNO_UTILS_FIXED_BYTES_H_
+#define DYNO_UTILS_FIXED_BYTES_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace dyno::bytes {
+
+// A key of N raw bytes (a UUID, a hash, ...), ordered like its bytes as a
+// string. All zeros is the null key, as 0 is for integer keys. Comparisons
+// use memcmp, which stops at the first difference; with kConstantTime they
+// look at every byte and do not branch on the data.
+template<size_t N, bool kConstantTime = false>
+class FixedBytes {
+ public:
+  std::array<uint8_t, N> bytes_{};
+
+  FixedBytes() = default;
+  explicit FixedBytes(const uint8_t *data) {
+    std::memcpy(bytes_.data(), data, N);
+  }
+
+  // <0, 0 or >0, like memcmp.
+  [[nodiscard]] int Compare(const FixedBytes &other) const {
+    if constexpr (!kConstantTime) {
+      return std::memcmp(bytes_.data(), other.bytes_.data(), N);
+    } else {
+      // From the last byte to the first, each differing byte overrides the
+      // result, so the first one decides.
+      int32_t res = 0;
+      for (size_t i = N; i-- > 0;) {
+        int32_t diff = int32_t(bytes_[i]) - int32_t(other.bytes_[i]);
+        int32_t differs = (diff | -diff) >> 31; // All ones iff diff != 0.
+        res = (diff & differs) | (res & ~differs);
+      }
+      return res;
+    }
+  }
+
+  friend bool operator==(const FixedBytes &a, const FixedBytes &b) {
+    return a.Compare(b) == 0;
+  }
+  friend bool operator!=(const FixedBytes &a, const FixedBytes &b) {
+    return a.Compare(b) != 0;
+  }
+  friend bool operator<(const FixedBytes &a, const FixedBytes &b) {
+    return a.Compare(b) < 0;
+  }
+  friend bool operator<=(const FixedBytes &a, const FixedBytes &b) {
+    return a.Compare(b) <= 0;
+  }
+  friend bool operator>(const FixedBytes &a, const FixedBytes &b) {
+    return a.Compare(b) > 0;
+  }
+  friend bool operator>=(const FixedBytes &a, const FixedBytes &b) {
+    return a.Compare(b) >= 0;
+  }
+};
+
+} // namespace dyno::bytes
+
+#endif //DYNO_UTILS_FIXED_BYTES_H_
@@ -0,0 +1,70 @@
+#ifndef DYNO_UTILS_GROWTH_STEPS_H_
+#define DYNO_UTILS_GROWTH_STEPS_H_
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+namespace dyno::utils {
+
+// The capacities a dynamic stepping structure switches sub-structures at:
+// 1, then each step the previous one times `factor`, rounded up (and at least
+// one more). Factor 2 gives the powers of two. Between steps s and t the
+// structure keeps sub-structures of capacity s and t, so right after a step it
+// takes about (1 + factor) times the memory of its contents.
+//
+// The price is MovesToEmpty(s) = ceil(s / (t - s)) moves per Grow or Shrink,
+// about 1 / (factor - 1): 1 for factor 2, 2 for 1.5, 10 for 1.1. As the factor
+// nears 1 that grows toward s, as then t = s + 1.
+//
+// All steps up to about SIZE_MAX / 4 are kept, log(SIZE_MAX) / log(factor) of
+// them. Factors below kMinFactor (or NaN) are raised to it in every build, as
+// the table would get too long.
+class GrowthSteps {
+ public:
+  static constexpr double kMinFactor = 1.01;
+
+  explicit GrowthSteps(double factor = 2) {
+    if (!(factor >= kMinFactor))
+      factor = kMinFactor;
+    const size_t max_step = std::numeric_limits<size_t>::max() / 4;
+    for (size_t s = 1;;) {
+      steps_.push_back(s);
+      auto next = std::ceil(static_cast<long double>(s) * factor);
+      if (next > static_cast<long double>(max_step))
+        break;
+      s = std::max(s + 1, static_cast<size_t>(next));
+    }
+  }
+
+  [[nodiscard]] bool IsStep(size_t c) const {
+    return std::binary_search(steps_.begin(), steps_.end(), c);
+  }
+  // The largest step below c; 0 for c <= 1.
+  [[nodiscard]] size_t Below(size_t c) const {
+    auto it = std::lower_bound(steps_.begin(), steps_.end(), c);
+    return it == steps_.begin() ? 0 : *--it;
+  }
+  // The smallest step above c.
+  [[nodiscard]] size_t Above(size_t c) const {
+    auto it = std::upper_bound(steps_.begin(), steps_.end(), c);
+    assert(it != steps_.end());
+    return *it;
+  }
+  // For a step s, the pairs to move per Grow to empty a full sub-structure of
+  // capacity s by the next step: ceil(s / (Above(s) - s)). 1 for factor 2.
+  [[nodiscard]] size_t MovesToEmpty(size_t s) const {
+    size_t d = Above(s) - s;
+    return (s + d - 1) / d;
+  }
+
+ private:
+  std::vector<size_t> steps_; // Increasing.
+};
+
+} // namespace dyno::utils
+
+#endif //DYNO_UTILS_GROWTH_STEPS_H_
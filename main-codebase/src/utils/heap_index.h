@@ -0,0 +1,27 @@
+#ifndef DYNO_UTILS_HEAP_INDEX_H_
+#define DYNO_UTILS_HEAP_INDEX_H_
+
+#include <cassert>
+#include <cstdint>
+
+namespace dyno::utils {
+
+// Helpers for 1-based heap indexes: the root is 1, and the children of i are
+// 2i and 2i + 1.
+
+// The level of i, the root's being 0.
+inline unsigned int HeapLevel(uint64_t i) {
+  assert(i > 0);
+  return 63 - __builtin_clzll(i);
+}
+
+// Whether a is i or one of its ancestors: i shifted up to a's level is a.
+inline bool IsHeapAncestor(uint64_t a, uint64_t i) {
+  unsigned int la = HeapLevel(a);
+  unsigned int li = HeapLevel(i);
+  return la <= li && (i >> (li - la)) == a;
+}
+
+} // namespace dyno::utils
+
+#endif //DYNO_UTILS_HEAP_INDEX_H_
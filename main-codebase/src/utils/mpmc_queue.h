@@ -0,0 +1,90 @@
+#ifndef DYNO_UTILS_MPMC_QUEUE_H_
+#define DYNO_UTILS_MPMC_QUEUE_H_
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+namespace dyno::utils {
+
+// Bounded lock-free multi-producer multi-consumer queue.
+// Src: Dmitry Vyukov's bounded MPMC queue (1024cores.net).
+template<typename T>
+class MpmcQueue {
+ public:
+  // capacity must be a power of two.
+  explicit MpmcQueue(size_t capacity)
+      : cells_(std::make_unique<Cell[]>(capacity)), mask_(capacity - 1) {
+    assert(capacity >= 2 && !(capacity & (capacity - 1)));
+    for (size_t i = 0; i < capacity; ++i)
+      cells_[i].seq_.store(i, std::memory_order_relaxed);
+  }
+
+  MpmcQueue(const MpmcQueue &) = delete;
+  MpmcQueue &operator=(const MpmcQueue &) = delete;
+
+  // Returns false, leaving v untouched, if the queue is full.
+  bool TryPush(T &v) {
+    Cell *cell;
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    while (true) {
+      cell = &cells_[pos & mask_];
+      size_t seq = cell->seq_.load(std::memory_order_acquire);
+      auto dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+      if (dif == 0) {
+        if (enqueue_pos_.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed))
+          break;
+      } else if (dif < 0) {
+        return false;
+      } else {
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    cell->data_ = std::move(v);
+    cell->seq_.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Returns false if the queue is empty.
+  bool TryPop(T &v) {
+    Cell *cell;
+    size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    while (true) {
+      cell = &cells_[pos & mask_];
+      size_t seq = cell->seq_.load(std::memory_order_acquire);
+      auto dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+      if (dif == 0) {
+        if (dequeue_pos_.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed))
+          break;
+      } else if (dif < 0) {
+        return false;
+      } else {
+        pos = dequeue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    v = std::move(cell->data_);
+    cell->seq_.store(pos + mask_ + 1, std::memory_order_release);
+    return true;
+  }
+
+ private:
+  class Cell {
+   public:
+    std::atomic<size_t> seq_;
+    T data_;
+  };
+
+  std::unique_ptr<Cell[]> cells_;
+  const size_t mask_;
+  alignas(64) std::atomic<size_t> enqueue_pos_ = 0;
+  alignas(64) std::atomic<size_t> dequeue_pos_ = 0;
+};
+
+} // namespace dyno::utils
+
+#endif //DYNO_UTILS_MPMC_QUEUE_H_
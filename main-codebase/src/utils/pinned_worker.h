@@ -0,0 +1,109 @@
+#ifndef DYNO_UTILS_PINNED_WORKER_H_
+#define DYNO_UTILS_PINNED_WORKER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "mpmc_queue.h"
+
+namespace dyno::utils {
+
+// A thread, pinned to one core where the platform allows it, that runs the
+// tasks pushed to its lock-free queue in order. Meant to be the only thread
+// touching the state its tasks work on.
+//
+// The queue is lock-free while it has tasks and room; the worker sleeps when
+// it is empty, and Submit when it is full, so an idle worker holds no core.
+// The mutex is only taken to go to sleep or to wake a sleeper.
+class PinnedWorker {
+ public:
+  using Task = std::function<void()>;
+
+  explicit PinnedWorker(unsigned core, size_t queue_capacity = 1024)
+      : queue_(queue_capacity), thread_(&PinnedWorker::Loop, this) {
+#ifdef __linux__
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(core % std::thread::hardware_concurrency(), &cpus);
+    pthread_setaffinity_np(thread_.native_handle(), sizeof(cpus), &cpus);
+#endif
+  }
+
+  ~PinnedWorker() {
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      stop_ = true;
+    }
+    not_empty_.notify_all();
+    thread_.join();
+  }
+
+  PinnedWorker(const PinnedWorker &) = delete;
+  PinnedWorker &operator=(const PinnedWorker &) = delete;
+
+  void Submit(Task task) {
+    if (!queue_.TryPush(task)) {
+      std::unique_lock<std::mutex> lock(mu_);
+      ++full_waiters_;
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      not_full_.wait(lock, [&] { return queue_.TryPush(task); });
+      --full_waiters_;
+    }
+    Wake(empty_waiters_, not_empty_);
+  }
+
+ private:
+  MpmcQueue<Task> queue_;
+  std::mutex mu_;
+  std::condition_variable not_empty_; // Wakes the worker.
+  std::condition_variable not_full_; // Wakes blocked Submits.
+  // Threads asleep (or about to be) on each of them.
+  std::atomic<unsigned> empty_waiters_ = 0;
+  std::atomic<unsigned> full_waiters_ = 0;
+  bool stop_ = false; // Guarded by mu_.
+  std::thread thread_;
+
+  // After a push (or pop): a sleeper counted in `waiters` went to sleep
+  // before it, and is woken; a later one sees the queue change. The fences
+  // keep a push and a sleeper's count from both missing each other.
+  void Wake(const std::atomic<unsigned> &waiters,
+            std::condition_variable &cv) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!waiters.load())
+      return;
+    { std::lock_guard<std::mutex> lock(mu_); }
+    cv.notify_all();
+  }
+
+  void Loop() {
+    Task task;
+    while (true) {
+      if (!queue_.TryPop(task)) {
+        std::unique_lock<std::mutex> lock(mu_);
+        ++empty_waiters_;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        not_empty_.wait(lock, [&] { return queue_.TryPop(task) || stop_; });
+        --empty_waiters_;
+        if (!task)
+          return; // Stopped, and nothing left to run.
+      }
+      Wake(full_waiters_, not_full_);
+      task();
+      task = nullptr;
+    }
+  }
+};
+
+} // namespace dyno::utils
+
+#endif //DYNO_UTILS_PINNED_WORKER_H_
@@ -0,0 +1,126 @@
+#ifndef DYNO_UTILS_SHARD_SET_H_
+#define DYNO_UTILS_SHARD_SET_H_
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bytes.h"
+#include "crypto.h"
+#include "pinned_worker.h"
+
+namespace dyno::utils {
+
+// Shards of a sharded structure, each owned by its own PinnedWorker (shard i
+// on core i), with the keyed PRF that picks the shard of a key. Only the
+// methods used on a Shard type have to exist for it.
+template<typename Shard>
+class ShardSet {
+ public:
+  using MakeShard = std::function<std::unique_ptr<Shard>(unsigned int)>;
+
+  ShardSet(unsigned num_shards, const MakeShard &make)
+      : prf_key_(crypto::GenerateKey()) {
+    assert(num_shards > 0);
+    for (unsigned int i = 0; i < num_shards; ++i) {
+      shards_.push_back(make(i));
+      workers_.push_back(std::make_unique<PinnedWorker>(i));
+    }
+  }
+
+  // `file_path`.i, or empty (RAM) for an empty file_path.
+  static std::string ShardPath(const std::string &file_path, unsigned int i) {
+    return file_path.empty() ? "" : file_path + "." + std::to_string(i);
+  }
+
+  [[nodiscard]] unsigned NumShards() const { return shards_.size(); }
+  Shard &operator[](unsigned int i) { return *shards_[i]; }
+  const Shard &operator[](unsigned int i) const { return *shards_[i]; }
+
+  template<typename K>
+  [[nodiscard]] unsigned ShardOf(const K &k) const {
+    std::array<uint8_t, crypto::kDigestSize> digest{};
+    auto kb = bytes::ToBytes(k);
+    bool ok = crypto::Prf(prf_key_, kb.data(), kb.size(), digest.data());
+    assert(ok);
+    uint64_t h;
+    bytes::FromBytes(digest.data(), h);
+    return h % shards_.size();
+  }
+
+  // Runs fn(i) on the worker of every shard i, and waits for all of them.
+  // Rethrows the exception of the first shard whose fn threw, if any.
+  void OnAll(const std::function<void(unsigned int)> &fn) {
+    std::vector<std::promise<void>> done(shards_.size());
+    std::vector<std::future<void>> waits;
+    for (auto &d : done)
+      waits.push_back(d.get_future());
+    for (unsigned int i = 0; i < shards_.size(); ++i) {
+      workers_[i]->Submit([&fn, &done, i] {
+        try {
+          fn(i);
+          done[i].set_value();
+        } catch (...) {
+          done[i].set_exception(std::current_exception());
+        }
+      });
+    }
+    // The tasks refer to fn and done, so all must end before any rethrows.
+    for (auto &w : waits)
+      w.wait();
+    for (auto &w : waits)
+      w.get();
+  }
+
+  [[nodiscard]] size_t Capacity() const {
+    size_t res = 0;
+    for (auto &s : shards_)
+      res += s->Capacity();
+    return res;
+  }
+
+  [[nodiscard]] size_t Size() const {
+    size_t res = 0;
+    for (auto &s : shards_)
+      res += s->Size();
+    return res;
+  }
+
+  [[nodiscard]] uint64_t MemoryAccessCount() const {
+    uint64_t res = 0;
+    for (auto &s : shards_)
+      res += s->MemoryAccessCount();
+    return res;
+  }
+
+  [[nodiscard]] uint64_t MemoryBytesMovedTotal() const {
+    uint64_t res = 0;
+    for (auto &s : shards_)
+      res += s->MemoryBytesMovedTotal();
+    return res;
+  }
+
+  [[nodiscard]] bool IsOnDisk() const {
+    bool res = false;
+    for (auto &s : shards_)
+      res |= s->IsOnDisk();
+    return res;
+  }
+
+ private:
+  const crypto::Key prf_key_;
+  std::vector<std::unique_ptr<Shard>> shards_;
+  // Declared last, so the workers are joined before their shards go.
+  std::vector<std::unique_ptr<PinnedWorker>> workers_;
+};
+
+} // namespace dyno::utils
+
+#endif //DYNO_UTILS_SHARD_SET_H_
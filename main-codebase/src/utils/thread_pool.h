@@ -0,0 +1,100 @@
+#ifndef DYNO_UTILS_THREAD_POOL_H_
+#define DYNO_UTILS_THREAD_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace dyno::utils {
+
+// A fixed set of worker threads for fork-join loops. The calling thread takes
+// part in the work too, so ThreadPool(1) runs everything inline.
+// ParallelFor may only be called by one thread at a time.
+class ThreadPool {
+ public:
+  explicit ThreadPool(unsigned num_threads) {
+    for (unsigned i = 1; i < num_threads; ++i)
+      workers_.emplace_back(&ThreadPool::WorkerLoop, this);
+  }
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto &w : workers_)
+      w.join();
+  }
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  [[nodiscard]] unsigned NumThreads() const { return workers_.size() + 1; }
+
+  // Runs fn(i) for every i in [0, n), and returns once all calls are done.
+  void ParallelFor(size_t n, const std::function<void(size_t)> &fn) {
+    if (workers_.empty() || n < 2) {
+      for (size_t i = 0; i < n; ++i)
+        fn(i);
+      return;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      fn_ = &fn;
+      n_ = n;
+      next_ = 0;
+      busy_ = workers_.size();
+      ++generation_;
+    }
+    cv_.notify_all();
+    RunTasks();
+
+    std::unique_lock<std::mutex> lock(mu_);
+    done_cv_.wait(lock, [&] { return busy_ == 0; });
+    fn_ = nullptr;
+  }
+
+ private:
+  std::vector<std::thread> workers_;
+  std::mutex mu_;
+  std::condition_variable cv_;
+  std::condition_variable done_cv_;
+  const std::function<void(size_t)> *fn_ = nullptr;
+  size_t n_ = 0;
+  std::atomic<size_t> next_ = 0;
+  size_t busy_ = 0;
+  uint64_t generation_ = 0;
+  bool stop_ = false;
+
+  void RunTasks() {
+    for (size_t i = next_++; i < n_; i = next_++)
+      (*fn_)(i);
+  }
+
+  void WorkerLoop() {
+    uint64_t seen = 0;
+    std::unique_lock<std::mutex> lock(mu_);
+    while (true) {
+      cv_.wait(lock, [&] { return stop_ || generation_ != seen; });
+      if (stop_)
+        return;
+      seen = generation_;
+      lock.unlock();
+      RunTasks();
+      lock.lock();
+      if (!--busy_)
+        done_cv_.notify_one();
+    }
+  }
+};
+
+} // namespace dyno::utils
+
+#endif //DYNO_UTILS_THREAD_POOL_H_